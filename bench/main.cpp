@@ -0,0 +1,304 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dndaction.h"
+#include "dragsource.h"
+#include "droparea.h"
+#include "dropdiff.h"
+#include "dropsimulator.h"
+#include "payloadgenerator.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QLoggingCategory>
+#include <QMimeData>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "config.h"
+
+static const qint64 s_chunkSize = 1024 * 1024;
+
+
+static Payload syntheticPayload(qint64 size, int seed)
+{
+    QByteArray chunk(int(qMin(size, s_chunkSize)), Qt::Uninitialized);
+    for( int i = 0; i < chunk.size(); ++i )
+        chunk[i] = char((quint32(i + seed) * 2654435761u) >> 24);
+
+    Payload::Writer writer(size);
+    for( qint64 pos = 0; pos < size; pos += chunk.size() )
+        writer.append(chunk.constData(), qMin(qint64(chunk.size()), size - pos));
+
+    return writer.finish();
+}
+
+static DnDAction syntheticAction(int formats, qint64 size)
+{
+    DnDAction act;
+    act.supportedActions = Qt::CopyAction | Qt::MoveAction;
+    act.defaultAction = Qt::CopyAction;
+    for( int i = 0; i < formats; ++i )
+        act.data.append(DnDAction::DataEntry(QString("application/x-dndbench-%1").arg(i),
+                                             syntheticPayload(size, i)));
+    return act;
+}
+
+static double percentile(const std::vector<qint64> &sorted, double p)
+{
+    if( sorted.empty() )
+        return 0;
+
+    const size_t idx = size_t(std::max(0.0, std::ceil(p * sorted.size()) - 1));
+    return double(sorted.at(std::min(idx, sorted.size() - 1))) / 1e6;
+}
+
+// Checks a diff against a byte by byte reference: prefix and suffix, and
+// that the segments rebuild b from a.
+static bool checkDiff(const QByteArray &a, const QByteArray &b, qint64 *literalBytes = 0)
+{
+    PayloadDiff d;
+    PayloadDiff::compute(Payload::fromHeap(a), Payload::fromHeap(b), &d);
+
+    const int common = qMin(a.size(), b.size());
+    int prefix = 0;
+    while( prefix < common && a.at(prefix) == b.at(prefix) )
+        ++prefix;
+    const bool equal = prefix == common && a.size() == b.size();
+    if( equal != d.isEqual() )
+        return false;
+    if( ! equal ) {
+        int suffix = 0;
+        while( suffix < common - prefix && a.at(a.size() - 1 - suffix) == b.at(b.size() - 1 - suffix) )
+            ++suffix;
+        if( d.firstMismatch != prefix || d.commonPrefix != prefix || d.commonSuffix != suffix )
+            return false;
+    }
+
+    qint64 pos = 0, matched = 0, literal = 0;
+    for( const auto &s : d.segments ) {
+        if( s.offset != pos || s.length <= 0 )
+            return false;
+        if( s.source >= 0 ) {
+            if( s.source + s.length > a.size()
+                    || std::memcmp(a.constData() + s.source, b.constData() + s.offset, size_t(s.length)) != 0 )
+                return false;
+            matched += s.length;
+        } else {
+            literal += s.length;
+        }
+        pos += s.length;
+    }
+    if( literalBytes )
+        *literalBytes = literal;
+
+    return pos == b.size() && matched == d.matchedBytes && literal == d.literalBytes;
+}
+
+// The scans have a vector and a word-wise variant depending on the build, so
+// this runs in every configuration that should be trusted.
+static bool selfCheckDiff(QTextStream &out)
+{
+    std::mt19937 rng(1);
+    auto randomBytes = [&rng](int size) {
+        QByteArray bytes(size, Qt::Uninitialized);
+        for( int i = 0; i < size; ++i )
+            bytes[i] = char(rng());
+        return bytes;
+    };
+
+    // Mismatches at every position around the word and vector boundaries.
+    for( int size = 0; size < 80; ++size ) {
+        const QByteArray a = randomBytes(size);
+        if( ! checkDiff(a, a) ) {
+            out << "diff check failed: equal payloads of " << size << " bytes\n";
+            return false;
+        }
+        for( int pos = 0; pos < size; ++pos ) {
+            QByteArray b = a;
+            b[pos] = char(b.at(pos) ^ 1);
+            if( ! checkDiff(a, b) || ! checkDiff(a, b.left(pos)) || ! checkDiff(b.left(pos), a) ) {
+                out << "diff check failed: mismatch at " << pos << " of " << size << " bytes\n";
+                return false;
+            }
+        }
+    }
+
+    // Random edits, so that the rolling hash has to resynchronize.
+    for( int i = 0; i < 200; ++i ) {
+        const QByteArray a = randomBytes(1 + int(rng() % 300000));
+        QByteArray b = a;
+        for( int edits = int(rng() % 5); edits > 0; --edits ) {
+            const int at = int(rng() % uint(b.size() + 1));
+            switch( rng() % 3 ) {
+            case 0:
+                b.insert(at, randomBytes(int(rng() % 200)));
+                break;
+            case 1:
+                b.remove(at, int(rng() % 500));
+                break;
+            default:
+                if( at < b.size() )
+                    b[at] = char(b.at(at) ^ 0x55);
+            }
+        }
+        if( ! checkDiff(a, b) ) {
+            out << "diff check failed: random edits, case " << i << "\n";
+            return false;
+        }
+    }
+
+    // A moved block has to be found again.
+    const QByteArray a = randomBytes(256 * 1024);
+    const QByteArray b = a.mid(100000, 50000) + a.left(100000) + a.mid(150000);
+    qint64 literal = -1;
+    if( ! checkDiff(a, b, &literal) || literal != 0 ) {
+        out << "diff check failed: moved block, " << literal << " literal bytes\n";
+        return false;
+    }
+
+    out << "diff check passed\n";
+    return true;
+}
+
+static qint64 peakRssKiB()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if( getrusage(RUSAGE_SELF, &usage) == 0 )
+        return usage.ru_maxrss;
+#endif
+    return -1;
+}
+
+
+int main(int argc, char *argv[])
+{
+    if( qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM") )
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication a(argc, argv);
+    a.setApplicationName("DragonDropTest-Benchmark");
+    a.setApplicationVersion(DRAGONDROPTEST_VERSION_STRING);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the drag source to drop data model round trip.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption formatsOption("formats", "Number of formats per drag.", "count", "4");
+    QCommandLineOption sizesOption("sizes", "Comma separated payload sizes per format, K/M/G suffixes allowed.",
+                                   "sizes", "1K,64K,1M,16M");
+    QCommandLineOption iterationsOption("iterations", "Round trips per size.", "count", "50");
+    QCommandLineOption handOverOption("hand-over", "Let the target take the payloads over directly "
+                                                   "instead of reading them through QMimeData.");
+    QCommandLineOption checkDiffOption("check-diff", "Check the payload diff against a byte by byte "
+                                                     "reference instead of benchmarking.");
+    parser.addOption(formatsOption);
+    parser.addOption(sizesOption);
+    parser.addOption(iterationsOption);
+    parser.addOption(handOverOption);
+    parser.addOption(checkDiffOption);
+    parser.process(a);
+
+    if( parser.isSet(checkDiffOption) ) {
+        QTextStream out(stdout);
+        return selfCheckDiff(out) ? 0 : 1;
+    }
+
+    const int formats = parser.value(formatsOption).toInt();
+    const int iterations = parser.value(iterationsOption).toInt();
+    if( formats < 1 || iterations < 1 ) {
+        qCritical("Invalid format or iteration count");
+        return 1;
+    }
+
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    QTextStream out(stdout);
+    out.setFieldAlignment(QTextStream::AlignRight);
+    const bool handOver = parser.isSet(handOverOption);
+    out << "formats " << formats << ", iterations " << iterations
+        << (handOver ? ", payload hand-over" : ", through QMimeData") << "\n";
+    out << qSetFieldWidth(12)
+        << "size" << "MB/s" << "p50 ms" << "p90 ms" << "p99 ms" << "max ms" << "peak RSS KiB"
+        << qSetFieldWidth(0) << "\n";
+
+    for( const auto &sizeString : parser.value(sizesOption).split(',', QString::SkipEmptyParts) ) {
+        const qint64 size = PayloadGenerator::parseSize(sizeString);
+        if( size < 0 || size > std::numeric_limits<int>::max() ) {
+            qCritical("Invalid payload size %s", qPrintable(sizeString));
+            return 1;
+        }
+
+        DragSource source;
+        DropArea target;
+        target.setPayloadHandOver(handOver);
+        target.resize(200, 200);
+        target.show();
+        DropDataModel model;
+        QObject::connect(&target, &DropArea::dataDropped, &model, &DropDataModel::setDropData);
+
+        source.setData(syntheticAction(formats, size));
+
+        std::vector<qint64> samples;
+        samples.reserve(size_t(iterations));
+        QElapsedTimer timer;
+        for( int i = 0; i < iterations; ++i ) {
+            timer.start();
+            std::unique_ptr<QMimeData> mimeData(source.toNewMimeData());
+            const Qt::DropAction action = DropSimulator::drop(&target, mimeData.get(), Qt::CopyAction | Qt::MoveAction);
+            samples.push_back(timer.nsecsElapsed());
+
+            if( action == Qt::IgnoreAction || model.rowCount() != formats ) {
+                qCritical("Drop was not accepted");
+                return 1;
+            }
+            a.processEvents();
+        }
+
+        std::sort(samples.begin(), samples.end());
+        qint64 total = 0;
+        for( const auto s : samples )
+            total += s;
+        const double meanSecs = double(total) / samples.size() / 1e9;
+        const double mbPerSec = double(size) * formats / (1024 * 1024) / meanSecs;
+
+        out << qSetFieldWidth(12)
+            << sizeString << QString::number(mbPerSec, 'f', 1)
+            << QString::number(percentile(samples, 0.5), 'f', 3)
+            << QString::number(percentile(samples, 0.9), 'f', 3)
+            << QString::number(percentile(samples, 0.99), 'f', 3)
+            << QString::number(percentile(samples, 1.0), 'f', 3)
+            << peakRssKiB()
+            << qSetFieldWidth(0) << "\n";
+        out.flush();
+    }
+
+    return 0;
+}
@@ -0,0 +1,220 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batchrunner.h"
+
+#include "dragsource.h"
+#include "droparea.h"
+#include "dropsimulator.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QMimeData>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+static double percentileMsecs(const std::vector<qint64> &sorted, double p)
+{
+    if( sorted.empty() )
+        return 0;
+
+    const size_t idx = size_t(std::max(0.0, std::ceil(p * sorted.size()) - 1));
+    return double(sorted.at(std::min(idx, sorted.size() - 1))) / 1e6;
+}
+
+// Always compares the bytes: received payloads may be the very storage that
+// was sent, e.g. when deduplicated by the PayloadStore, which says nothing
+// about the transport.
+static bool samePayload(const Payload &a, const Payload &b)
+{
+    if( a.isNull() != b.isNull() || a.size() != b.size() )
+        return false;
+    return a.size() == 0 || std::memcmp(a.constData(), b.constData(), size_t(a.size())) == 0;
+}
+
+
+BatchRunner::BatchRunner()
+    : mMode(Clipboard)
+    , mIterations(1)
+    , mSettleMsecs(0)
+    , mPromiseMode(true)
+{
+}
+
+void BatchRunner::setMode(Mode mode)
+{
+    mMode = mode;
+}
+
+void BatchRunner::setIterations(int iterations)
+{
+    mIterations = qMax(1, iterations);
+}
+
+void BatchRunner::setSettleMsecs(int msecs)
+{
+    mSettleMsecs = qMax(0, msecs);
+}
+
+void BatchRunner::setPromiseMode(bool promise)
+{
+    mPromiseMode = promise;
+}
+
+bool BatchRunner::modeFromString(const QString &name, Mode *mode)
+{
+    if( name == "clipboard" )
+        *mode = Clipboard;
+    else if( name == "drag" )
+        *mode = Drag;
+    else
+        return false;
+    return true;
+}
+
+bool BatchRunner::run(const DragSourceModel &model, QJsonObject *report)
+{
+    DragSource source;
+    source.setPromiseMode(mPromiseMode);
+    DropArea target;
+    // The point is to exercise the transport, not to share the entries.
+    target.setPayloadHandOver(false);
+    target.resize(200, 200);
+    if( mMode == Drag )
+        target.show();
+
+    int capturedAction = Qt::IgnoreAction;
+    DnDAction captured;
+    DropTimings timings;
+    bool received = false;
+    QObject::connect(&target, &DropArea::dropMeasured, [&](const DropTimings &t) {
+        timings = t;
+    });
+    QObject::connect(&target, &DropArea::dataDropped, [&](int dropAction, const DnDAction &data) {
+        capturedAction = dropAction;
+        captured = data;
+        received = true;
+    });
+
+    QJsonArray results;
+    std::vector<qint64> samples;
+    int failures = 0;
+    QElapsedTimer timer;
+
+    for( int iteration = 0; iteration < mIterations; ++iteration ) {
+        for( int idx = 0; idx < model.rowCount(); ++idx ) {
+            const auto &entry = model.at(idx);
+            source.setData(entry.action);
+            received = false;
+            captured = DnDAction();
+
+            qint64 nsecs = 0;
+            if( mMode == Clipboard ) {
+                timer.start();
+                QApplication::clipboard()->setMimeData(source.toNewMimeData());
+                nsecs = timer.nsecsElapsed();
+                // The settle time is not part of the round trip.
+                QElapsedTimer settle;
+                settle.start();
+                do {
+                    QApplication::processEvents(QEventLoop::AllEvents, 10);
+                } while( settle.elapsed() < mSettleMsecs );
+                timer.start();
+                target.fromClipboard();
+                nsecs += timer.nsecsElapsed();
+            } else {
+                timer.start();
+                std::unique_ptr<QMimeData> mimeData(source.toNewMimeData());
+                DropSimulator::drop(&target, mimeData.get(), entry.action.supportedActions);
+                nsecs = timer.nsecsElapsed();
+            }
+            samples.push_back(nsecs);
+
+            QJsonObject r = received ? compare(entry.action, captured) : QJsonObject();
+            const bool ok = received && r.value("ok").toBool();
+            r["ok"] = ok;
+            r["entry"] = entry.name;
+            r["iteration"] = iteration;
+            r["roundTripMs"] = double(nsecs) / 1e6;
+            if( received ) {
+                r["action"] = DropDataModel::actionString(capturedAction);
+                r["timings"] = timings.toJson();
+            } else {
+                r["error"] = QStringLiteral("nothing received");
+            }
+            results.append(r);
+
+            if( ! ok )
+                ++failures;
+
+            QApplication::processEvents();
+        }
+    }
+
+    if( mMode == Clipboard )
+        QApplication::clipboard()->clear();
+
+    std::sort(samples.begin(), samples.end());
+
+    QJsonObject summary;
+    summary["roundTrips"] = int(samples.size());
+    summary["failures"] = failures;
+    summary["p50Ms"] = percentileMsecs(samples, 0.5);
+    summary["p90Ms"] = percentileMsecs(samples, 0.9);
+    summary["p99Ms"] = percentileMsecs(samples, 0.99);
+    summary["maxMs"] = percentileMsecs(samples, 1.0);
+
+    (*report)["mode"] = mMode == Clipboard ? QStringLiteral("clipboard") : QStringLiteral("drag");
+    (*report)["promise"] = mPromiseMode;
+    (*report)["iterations"] = mIterations;
+    (*report)["summary"] = summary;
+    (*report)["results"] = results;
+
+    return failures == 0;
+}
+
+// Every sent format has to arrive unchanged; targets may add formats.
+QJsonObject BatchRunner::compare(const DnDAction &sent, const DnDAction &received) const
+{
+    QJsonArray missing;
+    QJsonArray changed;
+    for( const auto &s : sent.data ) {
+        auto it = std::find_if(received.data.cbegin(), received.data.cend(), [&](const DnDAction::DataEntry &e) {
+            return e.mime() == s.mime();
+        });
+        if( it == received.data.cend() )
+            missing.append(s.mime());
+        else if( ! samePayload(s.payload(), it->payload()) )
+            changed.append(s.mime());
+    }
+
+    QJsonObject r;
+    r["formats"] = received.data.size();
+    if( ! missing.isEmpty() )
+        r["missing"] = missing;
+    if( ! changed.isEmpty() )
+        r["changed"] = changed;
+    r["ok"] = missing.isEmpty() && changed.isEmpty();
+    return r;
+}
@@ -0,0 +1,65 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include "dndaction.h"
+#include "droptimings.h"
+
+#include <QJsonObject>
+
+class DragSourceModel;
+
+
+// Headless replay of drag source configs, e.g. for CI under xvfb. Every
+// entry is put on the clipboard or dropped onto a local DropArea, captured
+// through the same code paths as interactive drops, compared against the
+// source data and recorded in a JSON report.
+class BatchRunner
+{
+public:
+    enum Mode {
+        Clipboard,
+        Drag
+    };
+
+    BatchRunner();
+
+    void setMode(Mode mode);
+    void setIterations(int iterations);
+    // Time an entry stays on the clipboard before it is read back, so that
+    // other clipboard consumers get a chance to fetch it.
+    void setSettleMsecs(int msecs);
+    void setPromiseMode(bool promise);
+
+    // Returns false if any round trip lost or changed data.
+    bool run(const DragSourceModel &model, QJsonObject *report);
+
+    static bool modeFromString(const QString &name, Mode *mode);
+
+private:
+    QJsonObject compare(const DnDAction &sent, const DnDAction &received) const;
+
+    Mode mMode;
+    int mIterations;
+    int mSettleMsecs;
+    bool mPromiseMode;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,222 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "chunkedhash.h"
+
+#include <QtEndian>
+
+#include <cstring>
+
+static const quint64 s_xxhPrime1 = 11400714785074694791ULL;
+static const quint64 s_xxhPrime2 = 14029467366897019727ULL;
+static const quint64 s_xxhPrime3 = 1609587929392839161ULL;
+static const quint64 s_xxhPrime4 = 9650029242287828579ULL;
+static const quint64 s_xxhPrime5 = 2870177450012600261ULL;
+
+static inline quint64 xxhRotl(quint64 x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline quint64 xxhRead64(const uchar *p)
+{
+    quint64 v;
+    std::memcpy(&v, p, sizeof(v));
+    return qFromLittleEndian(v);
+}
+
+static inline quint32 xxhRead32(const uchar *p)
+{
+    quint32 v;
+    std::memcpy(&v, p, sizeof(v));
+    return qFromLittleEndian(v);
+}
+
+static inline quint64 xxhRound(quint64 acc, quint64 input)
+{
+    acc += input * s_xxhPrime2;
+    acc = xxhRotl(acc, 31);
+    return acc * s_xxhPrime1;
+}
+
+static inline quint64 xxhMergeRound(quint64 acc, quint64 val)
+{
+    acc ^= xxhRound(0, val);
+    return acc * s_xxhPrime1 + s_xxhPrime4;
+}
+
+
+const int ChunkedHash::AlgorithmCount;
+const qint64 ChunkedHash::ChunkSize;
+
+ChunkedHash::ChunkedHash(Algorithm algorithm)
+    : mAlgorithm(algorithm)
+{
+    switch( mAlgorithm ) {
+    case Sha1:
+        mCrypto.reset(new QCryptographicHash(QCryptographicHash::Sha1));
+        break;
+    case Sha256:
+        mCrypto.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+        break;
+    case XxHash64:
+        break;
+    }
+    reset();
+}
+
+ChunkedHash::~ChunkedHash()
+{
+}
+
+ChunkedHash::Algorithm ChunkedHash::algorithm() const
+{
+    return mAlgorithm;
+}
+
+void ChunkedHash::reset()
+{
+    if( mCrypto )
+        mCrypto->reset();
+
+    mXxhAcc[0] = s_xxhPrime1 + s_xxhPrime2;
+    mXxhAcc[1] = s_xxhPrime2;
+    mXxhAcc[2] = 0;
+    mXxhAcc[3] = 0 - s_xxhPrime1;
+    mXxhTotal = 0;
+    mXxhBuffered = 0;
+}
+
+void ChunkedHash::addData(const char *data, qint64 len)
+{
+    if( ! mCrypto ) {
+        xxhAddData(reinterpret_cast<const uchar *>(data), len);
+        return;
+    }
+
+    for( qint64 pos = 0; pos < len; pos += ChunkSize )
+        mCrypto->addData(data + pos, int(qMin(ChunkSize, len - pos)));
+}
+
+QByteArray ChunkedHash::result()
+{
+    if( mCrypto )
+        return mCrypto->result();
+
+    const quint64 h = qToBigEndian(xxhResult());
+    return QByteArray(reinterpret_cast<const char *>(&h), sizeof(h));
+}
+
+QString ChunkedHash::name(Algorithm algorithm)
+{
+    switch( algorithm ) {
+    case Sha1: return QStringLiteral("SHA-1");
+    case Sha256: return QStringLiteral("SHA-256");
+    case XxHash64: return QStringLiteral("XXH64");
+    }
+    return {};
+}
+
+QString ChunkedHash::hexDigest(Algorithm algorithm, const char *data, qint64 len, const QAtomicInt *cancel)
+{
+    ChunkedHash hash(algorithm);
+    for( qint64 pos = 0; pos < len; pos += ChunkSize ) {
+        if( cancel && cancel->load() )
+            return {};
+        hash.addData(data + pos, qMin(ChunkSize, len - pos));
+    }
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString ChunkedHash::hexDigest(Algorithm algorithm, const Payload &payload, const QAtomicInt *cancel)
+{
+    return hexDigest(algorithm, payload.constData(), payload.size(), cancel);
+}
+
+void ChunkedHash::xxhAddData(const uchar *p, qint64 len)
+{
+    const uchar * const end = p + len;
+    mXxhTotal += quint64(len);
+
+    if( mXxhBuffered + len < 32 ) {
+        std::memcpy(mXxhBuffer + mXxhBuffered, p, size_t(len));
+        mXxhBuffered += int(len);
+        return;
+    }
+
+    if( mXxhBuffered > 0 ) {
+        const int fill = 32 - mXxhBuffered;
+        std::memcpy(mXxhBuffer + mXxhBuffered, p, size_t(fill));
+        for( int i = 0; i < 4; ++i )
+            mXxhAcc[i] = xxhRound(mXxhAcc[i], xxhRead64(mXxhBuffer + 8 * i));
+        p += fill;
+        mXxhBuffered = 0;
+    }
+
+    quint64 v1 = mXxhAcc[0], v2 = mXxhAcc[1], v3 = mXxhAcc[2], v4 = mXxhAcc[3];
+    for( ; p + 32 <= end; p += 32 ) {
+        v1 = xxhRound(v1, xxhRead64(p));
+        v2 = xxhRound(v2, xxhRead64(p + 8));
+        v3 = xxhRound(v3, xxhRead64(p + 16));
+        v4 = xxhRound(v4, xxhRead64(p + 24));
+    }
+    mXxhAcc[0] = v1; mXxhAcc[1] = v2; mXxhAcc[2] = v3; mXxhAcc[3] = v4;
+
+    if( p < end ) {
+        mXxhBuffered = int(end - p);
+        std::memcpy(mXxhBuffer, p, size_t(mXxhBuffered));
+    }
+}
+
+quint64 ChunkedHash::xxhResult() const
+{
+    quint64 h;
+    if( mXxhTotal >= 32 ) {
+        h = xxhRotl(mXxhAcc[0], 1) + xxhRotl(mXxhAcc[1], 7)
+                + xxhRotl(mXxhAcc[2], 12) + xxhRotl(mXxhAcc[3], 18);
+        for( int i = 0; i < 4; ++i )
+            h = xxhMergeRound(h, mXxhAcc[i]);
+    } else {
+        h = s_xxhPrime5;
+    }
+    h += mXxhTotal;
+
+    const uchar *p = mXxhBuffer;
+    const uchar * const end = mXxhBuffer + mXxhBuffered;
+    for( ; p + 8 <= end; p += 8 ) {
+        h ^= xxhRound(0, xxhRead64(p));
+        h = xxhRotl(h, 27) * s_xxhPrime1 + s_xxhPrime4;
+    }
+    if( p + 4 <= end ) {
+        h ^= quint64(xxhRead32(p)) * s_xxhPrime1;
+        h = xxhRotl(h, 23) * s_xxhPrime2 + s_xxhPrime3;
+        p += 4;
+    }
+    for( ; p < end; ++p ) {
+        h ^= (*p) * s_xxhPrime5;
+        h = xxhRotl(h, 11) * s_xxhPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= s_xxhPrime2;
+    h ^= h >> 29;
+    h *= s_xxhPrime3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,75 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHUNKEDHASH_H
+#define CHUNKEDHASH_H
+
+#include "payload.h"
+
+#include <QAtomicInt>
+#include <QCryptographicHash>
+#include <QScopedPointer>
+#include <QString>
+
+
+// Incremental hash over arbitrarily large inputs fed in chunks. Besides the
+// cryptographic digests provided by Qt it offers XXH64, which is fast enough
+// to run at memory bandwidth for quick comparisons of huge payloads.
+class ChunkedHash
+{
+public:
+    enum Algorithm {
+        Sha1,
+        Sha256,
+        XxHash64
+    };
+
+    static const int AlgorithmCount = XxHash64 + 1;
+    static const qint64 ChunkSize = 1024 * 1024;
+
+    explicit ChunkedHash(Algorithm algorithm);
+    ~ChunkedHash();
+
+    Algorithm algorithm() const;
+
+    void reset();
+    void addData(const char *data, qint64 len);
+    QByteArray result();
+
+    static QString name(Algorithm algorithm);
+
+    // Returns an empty string if cancel was set while hashing.
+    static QString hexDigest(Algorithm algorithm, const char *data, qint64 len,
+                             const QAtomicInt *cancel = nullptr);
+    static QString hexDigest(Algorithm algorithm, const Payload &payload,
+                             const QAtomicInt *cancel = nullptr);
+
+private:
+    void xxhAddData(const uchar *p, qint64 len);
+    quint64 xxhResult() const;
+
+    Algorithm mAlgorithm;
+    QScopedPointer<QCryptographicHash> mCrypto;
+
+    quint64 mXxhAcc[4];
+    quint64 mXxhTotal;
+    uchar mXxhBuffer[32];
+    int mXxhBuffered;
+};
+
+#endif // CHUNKEDHASH_H
@@ -6,4 +6,7 @@
 #define DRAGONDROPTEST_VERSION_PATCH ${DRAGONDROPTEST_VERSION_PATCH}
 #define DRAGONDROPTEST_VERSION_STRING "${DRAGONDROPTEST_VERSION_STRING}"
 
+#cmakedefine HAVE_COPY_FILE_RANGE
+#cmakedefine HAVE_SENDFILE
+
 #endif
\ No newline at end of file
@@ -18,9 +18,14 @@
 
 #include "dndaction.h"
 
-#include <QCryptographicHash>
+#include "chunkedhash.h"
+#include "memoryaccounting.h"
+#include "payloadstore.h"
+
 #include <QMimeDatabase>
 
+static const qint64 s_chunkSize = 1024 * 1024;
+
 
 QString DnDAction::actionsToString(Qt::DropActions actions)
 {
@@ -37,13 +42,80 @@ QString DnDAction::actionsToString(Qt::DropActions actions)
     return res.isEmpty() ? "ignore" : res;
 }
 
+DnDAction DnDAction::interned() const
+{
+    DnDAction act(*this);
+    for( auto &e : act.data )
+        e = e.interned();
+    return act;
+}
+
+// Shared between copies of a lazy entry, so that each format is fetched
+// from its source at most once.
+struct DnDAction::DataEntry::LazyPayload {
+    QSharedPointer<PayloadSource> source;
+    Payload payload;
+    bool cache = true;
+    bool fetched = false;
+};
+
+
 DnDAction::DataEntry::DataEntry()
 {
 }
 
 DnDAction::DataEntry::DataEntry(const QString &mime, const QByteArray &data)
-    : mMime(mime), mBytes(data), mFileExtension("?")
+    : mMime(mime), mPayload(Payload::fromHeap(data)), mFileExtension("?")
+{
+}
+
+DnDAction::DataEntry::DataEntry(const QString &mime, const Payload &payload)
+    : mMime(mime), mPayload(payload), mFileExtension("?")
+{
+}
+
+DnDAction::DataEntry::DataEntry(const QString &mime, const QSharedPointer<PayloadSource> &source)
+    : mMime(mime), mLazy(new LazyPayload), mFileExtension("?")
+{
+    mLazy->source = source;
+    mLazy->cache = source->isCacheable();
+}
+
+bool DnDAction::DataEntry::isFetched() const
+{
+    return ! mLazy || mLazy->fetched;
+}
+
+bool DnDAction::DataEntry::isAvailable() const
+{
+    return isFetched() || mLazy->source->isAvailable();
+}
+
+QSharedPointer<PayloadSource> DnDAction::DataEntry::source() const
 {
+    return mLazy ? mLazy->source : QSharedPointer<PayloadSource>();
+}
+
+DnDAction::DataEntry DnDAction::DataEntry::cachingEntry() const
+{
+    if( ! mLazy || mLazy->cache )
+        return *this;
+
+    DataEntry e(*this);
+    e.mLazy.reset(new LazyPayload);
+    e.mLazy->source = mLazy->source;
+    return e;
+}
+
+DnDAction::DataEntry DnDAction::DataEntry::interned() const
+{
+    if( ! isFetched() )
+        return *this;
+
+    DataEntry e(*this);
+    e.mPayload = PayloadStore::instance().intern(payload());
+    e.mLazy.reset();
+    return e;
 }
 
 QString DnDAction::DataEntry::mime() const
@@ -53,7 +125,26 @@ QString DnDAction::DataEntry::mime() const
 
 QByteArray DnDAction::DataEntry::bytes() const
 {
-    return mBytes;
+    return payload().toByteArray();
+}
+
+Payload DnDAction::DataEntry::payload() const
+{
+    if( ! mLazy )
+        return mPayload;
+
+    if( ! mLazy->fetched && mLazy->source->isAvailable() ) {
+        if( ! mLazy->cache )
+            return mLazy->source->fetch(mMime);
+
+        mLazy->payload = mLazy->source->fetch(mMime);
+        mLazy->fetched = true;
+        mLazy->source.reset();
+        // Whoever holds a copy of this entry holds the data now.
+        MemoryAccounting::instance().refresh();
+    }
+
+    return mLazy->payload;
 }
 
 QString DnDAction::DataEntry::fileExtension() const
@@ -68,33 +159,60 @@ QString DnDAction::DataEntry::fileExtension() const
 
 qint64 DnDAction::DataEntry::fileSize() const
 {
-    return mBytes.size();
+    return isFetched() ? payload().size() : mLazy->source->sizeHint();
 }
 
 QString DnDAction::DataEntry::sha1() const
 {
-    if( mSha1.isEmpty() ) {
-        QCryptographicHash hash(QCryptographicHash::Sha1);
-        hash.addData(mBytes);
-        mSha1 = QString::fromLatin1(hash.result().toHex());
-    }
+    if( mSha1.isEmpty() )
+        mSha1 = ChunkedHash::hexDigest(ChunkedHash::Sha1, payload());
 
     return mSha1;
 }
 
 
+// Same wire format as QByteArray, but streamed in chunks so that mapped
+// payloads are neither copied to the heap on save nor on load.
 QDataStream &operator<<(QDataStream &stream, const DnDAction::DataEntry &entry)
 {
-    return stream << entry.mime() << entry.bytes();
+    const Payload payload = entry.payload();
+    if( payload.size() >= 0xffffffff ) {
+        stream.setStatus(QDataStream::WriteFailed);
+        return stream;
+    }
+
+    stream << entry.mime() << quint32(payload.size());
+    const char *data = payload.constData();
+    for( qint64 pos = 0; pos < payload.size(); pos += s_chunkSize )
+        stream.writeRawData(data + pos, int(qMin(s_chunkSize, payload.size() - pos)));
+
+    return stream;
 }
 
 
 QDataStream &operator>>(QDataStream &stream, DnDAction::DataEntry &entry)
 {
     QString mime;
-    QByteArray bytes;
-    stream >> mime >> bytes;
-    entry = DnDAction::DataEntry(mime, bytes);
+    quint32 len;
+    stream >> mime >> len;
+    if( len == 0xffffffff ) {
+        entry = DnDAction::DataEntry(mime, QByteArray());
+        return stream;
+    }
+
+    Payload::Writer writer(len);
+    QByteArray chunk(int(qMin(s_chunkSize, qint64(len))), Qt::Uninitialized);
+    for( qint64 remaining = len; remaining > 0; ) {
+        const int n = int(qMin(qint64(chunk.size()), remaining));
+        if( stream.readRawData(chunk.data(), n) != n ) {
+            stream.setStatus(QDataStream::ReadPastEnd);
+            return stream;
+        }
+        writer.append(chunk.constData(), n);
+        remaining -= n;
+    }
+
+    entry = DnDAction::DataEntry(mime, writer.finish());
     return stream;
 }
 
@@ -19,6 +19,8 @@
 #ifndef DNDACTION_H
 #define DNDACTION_H
 
+#include "payload.h"
+
 #include <QDataStream>
 #include <QString>
 #include <QVector>
@@ -27,20 +29,37 @@
 class DnDAction
 {
 public:
+    // Entries hold their data as it arrived. Interning in the PayloadStore
+    // hashes the whole payload, so it is only done for long lived copies.
     class DataEntry {
     public:
         DataEntry();
         DataEntry(const QString &mime, const QByteArray &data);
+        DataEntry(const QString &mime, const Payload &payload);
+        DataEntry(const QString &mime, const QSharedPointer<PayloadSource> &source);
+
+        bool isFetched() const;
+        bool isAvailable() const;
+        QSharedPointer<PayloadSource> source() const;
+        // Copy that caches its payload even if the source is not cacheable.
+        DataEntry cachingEntry() const;
+        // Copy sharing the payload with equal data held elsewhere; entries
+        // that were not fetched yet are returned as they are.
+        DataEntry interned() const;
 
         QString mime() const;
         QByteArray bytes() const;
+        Payload payload() const;
         QString fileExtension() const;
         qint64 fileSize() const;
         QString sha1() const;
 
     private:
+        struct LazyPayload;
+
         QString mMime;
-        QByteArray mBytes;
+        Payload mPayload;
+        QSharedPointer<LazyPayload> mLazy;
         mutable QString mFileExtension;
         mutable QString mSha1;
     };
@@ -49,6 +68,8 @@ public:
     Qt::DropAction defaultAction = Qt::IgnoreAction;
     QVector<DataEntry> data;
 
+    DnDAction interned() const;
+
     static QString actionsToString(Qt::DropActions actions);
 };
 
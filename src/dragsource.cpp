@@ -18,10 +18,13 @@
 
 #include "dragsource.h"
 
+#include "chunkedhash.h"
+#include "payloadmimedata.h"
+
 #include <QApplication>
 #include <QClipboard>
-#include <QCryptographicHash>
 #include <QDrag>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QHBoxLayout>
 #include <QMessageBox>
@@ -33,6 +36,8 @@
 
 DragSource::DragSource(QWidget *parent)
     : QLabel(parent)
+    , mPromiseMode(true)
+    , mGenerationDelay(0)
 {
     setToolTip(tr("Drag data from here\nRight click: copy to clipboard"));
 }
@@ -42,12 +47,43 @@ void DragSource::setData(const DnDAction &action)
     mAction = action;
 }
 
+bool DragSource::promiseMode() const
+{
+    return mPromiseMode;
+}
+
+void DragSource::setPromiseMode(bool promise)
+{
+    mPromiseMode = promise;
+}
+
+int DragSource::generationDelay() const
+{
+    return mGenerationDelay;
+}
+
+void DragSource::setGenerationDelay(int msecs)
+{
+    mGenerationDelay = msecs;
+}
+
 QMimeData *DragSource::toNewMimeData() const
 {
+    if( mPromiseMode ) {
+        auto *mimeData = new PayloadMimeData(mAction.data);
+        mimeData->setGenerationDelay(mGenerationDelay);
+        return mimeData;
+    }
+
     QMimeData *mimeData = new QMimeData;
 
-    for( const auto &e : mAction.data)
-        mimeData->setData(e.mime(), e.bytes());
+    QVector<MemoryAccounting::Holding> holdings;
+    for( const auto &e : mAction.data) {
+        const QByteArray bytes = e.bytes();
+        mimeData->setData(e.mime(), bytes);
+        holdings.append(MemoryAccounting::Holding::of(bytes));
+    }
+    MemoryAccounting::instance().holdUntilDestroyed(mimeData, tr("Mime data"), holdings);
 
     return mimeData;
 }
@@ -55,10 +91,16 @@ QMimeData *DragSource::toNewMimeData() const
 void DragSource::mousePressEvent(QMouseEvent *ev)
 {
     if( ev->button() == Qt::LeftButton) {
+        QElapsedTimer timer;
+        timer.start();
         QDrag *drag = new QDrag(this);
-        drag->setMimeData(toNewMimeData());
+        drag->setMimeData(toNewTrackedMimeData());
+        const qint64 setupNsecs = timer.nsecsElapsed();
+        mResult = tr("dragging");
 
+        timer.restart();
         Qt::DropAction action = drag->exec(mAction.supportedActions, mAction.defaultAction);
+        const qint64 execNsecs = timer.nsecsElapsed();
         QString actionString;
         switch(action) {
         case Qt::CopyAction:
@@ -73,12 +115,15 @@ void DragSource::mousePressEvent(QMouseEvent *ev)
         default:
             actionString = tr("no");
         }
-        setText(tr("<drag content>\n(%1 action)").arg(actionString));
+        mResult = tr("%1 action").arg(actionString);
+        updateText();
+        emit dragMeasured(action, setupNsecs, execNsecs, mRetrieved);
 
         ev->accept();
     } else if( ev->button() == Qt::RightButton ) {
-        QApplication::clipboard()->setMimeData(toNewMimeData());
-        setText(tr("<drag content>\n(to clipboard)"));
+        QApplication::clipboard()->setMimeData(toNewTrackedMimeData());
+        mResult = tr("to clipboard");
+        updateText();
 
         ev->accept();
     }
@@ -96,10 +141,50 @@ void DragSource::mouseReleaseEvent(QMouseEvent *)
 {
 }
 
+void DragSource::onFormatRetrieved(const QString &mimeType, qint64 bytes, qint64 nsecs)
+{
+    if( sender() != mTracked )
+        return;
+
+    if( ! mRetrieved.contains(mimeType) )
+        mRetrieved.append(mimeType);
+    updateText();
+    emit formatRetrieved(mimeType, bytes, nsecs);
+}
+
+QMimeData *DragSource::toNewTrackedMimeData()
+{
+    mRetrieved.clear();
+
+    QMimeData *mimeData = toNewMimeData();
+    mTracked = mimeData;
+    if( auto *payloadData = qobject_cast<PayloadMimeData *>(mimeData) )
+        connect(payloadData, &PayloadMimeData::formatRetrieved, this, &DragSource::onFormatRetrieved);
+
+    return mimeData;
+}
 
+void DragSource::updateText()
+{
+    if( mPromiseMode ) {
+        setText(tr("<drag content>\n(%1)\n%2 of %3 formats retrieved").arg(mResult)
+                .arg(mRetrieved.size()).arg(mAction.data.size()));
+    } else {
+        setText(tr("<drag content>\n(%1)").arg(mResult));
+    }
+}
+
+
+
+DragSourceModel::DragSourceModel(QObject *parent)
+    : QAbstractListModel(parent)
+{
+    MemoryAccounting::instance().setProvider(this, tr("Drag sources"), [this]() { return holdings(); });
+}
 
 DragSourceModel::~DragSourceModel()
 {
+    MemoryAccounting::instance().release(this);
 }
 
 
@@ -139,11 +224,17 @@ const DragSourceModel::DragSourceEntry &DragSourceModel::at(int idx) const
     return mDragSources.at(idx);
 }
 
+const QVector<DragSourceModel::DragSourceEntry> &DragSourceModel::entries() const
+{
+    return mDragSources;
+}
+
 void DragSourceModel::clear()
 {
     beginResetModel();
     mDragSources.resize(0);
     endResetModel();
+    account();
     emit rowCountChanged();
 }
 
@@ -152,10 +243,48 @@ void DragSourceModel::append(const DragSourceEntry &entry)
     const int row = mDragSources.size();
     beginInsertRows(QModelIndex(), row, row);
     mDragSources.append(entry);
+    mDragSources.last().action = entry.action.interned();
     endInsertRows();
+    account();
+    emit rowCountChanged();
+}
+
+void DragSourceModel::setEntries(const QVector<DragSourceEntry> &entries)
+{
+    beginResetModel();
+    mDragSources = entries;
+    intern();
+    endResetModel();
+    account();
     emit rowCountChanged();
 }
 
+// Drag sources live for the whole session, so unlike drops their payloads
+// are shared with equal data held elsewhere.
+void DragSourceModel::intern()
+{
+    for( auto &entry : mDragSources )
+        entry.action = entry.action.interned();
+}
+
+void DragSourceModel::account()
+{
+    MemoryAccounting::instance().refresh(this);
+}
+
+// Formats of lazily loaded configs are only counted once they were read.
+QVector<MemoryAccounting::Holding> DragSourceModel::holdings() const
+{
+    QVector<MemoryAccounting::Holding> holdings;
+    for( const auto &entry : mDragSources ) {
+        for( const auto &e : entry.action.data ) {
+            if( e.isFetched() )
+                holdings.append(MemoryAccounting::Holding::of(e.payload()));
+        }
+    }
+    return holdings;
+}
+
 
 QDataStream &operator<<(QDataStream &stream, const DragSourceModel::DragSourceEntry &entry)
 {
@@ -176,7 +305,10 @@ QDataStream &operator<<(QDataStream &stream, const DragSourceModel &model)
 
 QDataStream &operator>>(QDataStream &stream, DragSourceModel &model)
 {
-    return stream >> model.mDragSources;
+    stream >> model.mDragSources;
+    model.intern();
+    model.account();
+    return stream;
 }
 
 
@@ -196,6 +328,11 @@ FormGenByteArrayWidget::FormGenByteArrayWidget(FormGenElement::ElementType type,
     updateInputWidgets();
 }
 
+FormGenByteArrayWidget::~FormGenByteArrayWidget()
+{
+    MemoryAccounting::instance().release(this);
+}
+
 QVariant FormGenByteArrayWidget::defaultValue() const
 {
     return QByteArray();
@@ -226,6 +363,8 @@ void FormGenByteArrayWidget::setVaidatedValueImpl(const QVariant &val)
     if( mValue != array ) {
         mValue = array;
         mInfo->setText(byteArraySummary(mValue));
+        MemoryAccounting::instance().setHoldings(this, tr("Byte array editors"),
+                                                 { MemoryAccounting::Holding::of(mValue) });
         emit valueChanged();
     }
 }
@@ -256,8 +395,6 @@ void FormGenByteArrayWidget::showFileChooser()
 
 QString FormGenByteArrayWidget::byteArraySummary(const QByteArray &array) const
 {
-    QCryptographicHash hash(QCryptographicHash::Sha1);
-    hash.addData(array);
     return tr("<BLOB %1 bytes, %2 SHA-1>").arg(QString::number(array.size()),
-                                               QString::fromLatin1(hash.result().toHex()));
+                                               ChunkedHash::hexDigest(ChunkedHash::Sha1, array.constData(), array.size()));
 }
@@ -20,11 +20,13 @@
 #define DRAGSOURCE_H
 
 #include "dndaction.h"
+#include "memoryaccounting.h"
 
 #include "formgenwidgetsbase.h"
 
 #include <QAbstractListModel>
 #include <QLabel>
+#include <QPointer>
 #include <QVector>
 
 
@@ -40,16 +42,38 @@ public:
 
     void setData(const DnDAction &action);
 
+    // In promise mode formats are only produced when the target asks for
+    // them, optionally with a simulated generation delay.
+    bool promiseMode() const;
+    void setPromiseMode(bool promise);
+    int generationDelay() const;
+    void setGenerationDelay(int msecs);
+
     QMimeData *toNewMimeData() const;
 
+signals:
+    void dragMeasured(int dropAction, qint64 setupNsecs, qint64 execNsecs, const QStringList &retrieved);
+    void formatRetrieved(const QString &mimeType, qint64 bytes, qint64 nsecs);
+
 protected:
     void mousePressEvent(QMouseEvent *ev) override;
     void mouseDoubleClickEvent(QMouseEvent *) override;
     void mouseMoveEvent(QMouseEvent *) override;
     void mouseReleaseEvent(QMouseEvent *) override;
 
+private slots:
+    void onFormatRetrieved(const QString &mimeType, qint64 bytes, qint64 nsecs);
+
 private:
+    QMimeData *toNewTrackedMimeData();
+    void updateText();
+
     DnDAction mAction;
+    bool mPromiseMode;
+    int mGenerationDelay;
+    QString mResult;
+    QStringList mRetrieved;
+    QPointer<QMimeData> mTracked;
 };
 
 
@@ -58,6 +82,7 @@ class DragSourceModel : public QAbstractListModel
     Q_OBJECT
 
 public:
+    explicit DragSourceModel(QObject *parent = 0);
     ~DragSourceModel();
 
     int rowCount(const QModelIndex &parent = {}) const override;
@@ -72,14 +97,20 @@ public:
     QVector<DragSourceEntry>::const_iterator end() const;
 
     const DragSourceEntry &at(int idx) const;
+    const QVector<DragSourceEntry> &entries() const;
 
     void clear();
     void append(const DragSourceEntry &entry);
+    void setEntries(const QVector<DragSourceEntry> &entries);
 
 signals:
     void rowCountChanged();
 
 private:
+    void intern();
+    void account();
+    QVector<MemoryAccounting::Holding> holdings() const;
+
     QVector<DragSourceEntry> mDragSources;
 
     friend QDataStream &operator<<(QDataStream &stream, const DragSourceModel &model);
@@ -95,6 +126,7 @@ class FormGenByteArrayWidget : public FormGenUnframedBase {
 
 public:
     explicit FormGenByteArrayWidget(ElementType type = Required, QWidget * parent = nullptr);
+    ~FormGenByteArrayWidget();
 
     QVariant defaultValue() const override;
 
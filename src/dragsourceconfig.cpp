@@ -0,0 +1,223 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dragsourceconfig.h"
+
+#include "dragsource.h"
+#include "payload.h"
+#include "payloadgenerator.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QFile>
+#include <QMultiHash>
+#include <QSaveFile>
+
+#include <cstring>
+
+static const char s_dragSourceConfigHeadV01[] = "DragonDropTest.dragSourceConfig.0.1";
+static const char s_dragSourceConfigHeadV02[] = "DragonDropTest.dragSourceConfig.0.2";
+
+static_assert(sizeof(s_dragSourceConfigHeadV01) == sizeof(s_dragSourceConfigHeadV02),
+              "config headers must have the same size");
+
+enum DataKind {
+    BlobData = 0,
+    GeneratedData = 1
+};
+
+static QString tr(const char *text)
+{
+    return QCoreApplication::translate("DragSourceConfig", text);
+}
+
+static bool loadIndex(const QByteArray &index, const QSharedPointer<PayloadFile> &file, qint64 dataStart,
+                      QVector<DragSourceModel::DragSourceEntry> &entries)
+{
+    QDataStream stream(index);
+    stream.setVersion(QDataStream::Qt_5_2);
+
+    const qint64 dataSize = file->size() - dataStart;
+
+    quint32 count;
+    stream >> count;
+    for( quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i ) {
+        DragSourceModel::DragSourceEntry e;
+        qint32 sup, def;
+        quint32 dataCount;
+        stream >> e.name >> sup >> def >> dataCount;
+        e.action.supportedActions = static_cast<Qt::DropActions>(sup);
+        e.action.defaultAction = static_cast<Qt::DropAction>(def);
+
+        for( quint32 j = 0; j < dataCount && stream.status() == QDataStream::Ok; ++j ) {
+            QString mime;
+            quint8 kind;
+            stream >> mime >> kind;
+
+            QSharedPointer<PayloadSource> source;
+            if( kind == BlobData ) {
+                qint64 offset, size;
+                stream >> offset >> size;
+                // Written so that corrupt values cannot overflow.
+                if( offset < 0 || size < 0 || offset > dataSize || size > dataSize - offset )
+                    return false;
+                source.reset(new FileRegionSource(file, dataStart + offset, size));
+            } else if( kind == GeneratedData ) {
+                QVariantMap spec;
+                stream >> spec;
+                auto *generator = new PayloadGenerator(spec);
+                source.reset(generator);
+                if( ! generator->isValid() )
+                    return false;
+            } else {
+                return false;
+            }
+
+            e.action.data.append(DnDAction::DataEntry(mime, source));
+        }
+
+        entries.append(e);
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
+
+bool DragSourceConfig::load(const QString &fileName, DragSourceModel &model, QString *errorString)
+{
+    model.clear();
+
+    QFile file(fileName);
+    if( ! file.open(QIODevice::ReadOnly) ) {
+        *errorString = tr("Cannot open config file %1").arg(fileName);
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+
+    char headerTmp[sizeof(s_dragSourceConfigHeadV02)];
+    if( stream.readRawData(headerTmp, sizeof(headerTmp)) != int(sizeof(headerTmp)) ) {
+        *errorString = tr("Invalid config file");
+        return false;
+    }
+
+    if( qstrcmp(headerTmp, s_dragSourceConfigHeadV01) == 0 ) {
+        DragSourceModel tmp;
+        stream >> tmp;
+        if( stream.status() != QDataStream::Ok ) {
+            *errorString = tr("Invalid config file");
+            return false;
+        }
+        model.setEntries(tmp.entries());
+        return true;
+    }
+
+    if( qstrcmp(headerTmp, s_dragSourceConfigHeadV02) != 0 ) {
+        *errorString = tr("Invalid config file");
+        return false;
+    }
+
+    QByteArray index;
+    stream >> index;
+    const qint64 dataStart = file.pos();
+
+    QSharedPointer<PayloadFile> payloadFile = PayloadFile::open(fileName);
+    QVector<DragSourceModel::DragSourceEntry> entries;
+    if( stream.status() != QDataStream::Ok || ! payloadFile
+            || ! loadIndex(index, payloadFile, dataStart, entries) ) {
+        *errorString = tr("Invalid config file");
+        return false;
+    }
+
+    model.setEntries(entries);
+    return true;
+}
+
+bool DragSourceConfig::save(const QString &fileName, const DragSourceModel &model, QString *errorString)
+{
+    QSaveFile file(fileName);
+    if( ! file.open(QIODevice::WriteOnly) ) {
+        *errorString = tr("Save drag config: cannot open file");
+        return false;
+    }
+
+    QVector<Payload> payloads;
+    // Content key to index in payloads and offset in the data section.
+    QMultiHash<QByteArray, QPair<int, qint64>> blobs;
+    QByteArray index;
+    {
+        QDataStream stream(&index, QIODevice::WriteOnly);
+        stream.setVersion(QDataStream::Qt_5_2);
+
+        qint64 offset = 0;
+        stream << quint32(model.rowCount());
+        for( const auto &entry : model ) {
+            stream << entry.name << qint32(entry.action.supportedActions)
+                   << qint32(entry.action.defaultAction) << quint32(entry.action.data.size());
+
+            for( const auto &e : entry.action.data ) {
+                const QVariantMap spec = e.source() ? e.source()->generatorSpec() : QVariantMap();
+                if( ! spec.isEmpty() ) {
+                    stream << e.mime() << quint8(GeneratedData) << spec;
+                    continue;
+                }
+
+                // Each unique blob is written once, equal formats refer to it.
+                const Payload payload = e.payload();
+                qint64 blobOffset = -1;
+                const QByteArray key = payload.contentKey();
+                for( auto it = blobs.find(key); it != blobs.end() && it.key() == key; ++it ) {
+                    const Payload &written = payloads.at(it.value().first);
+                    if( written.isSharedWith(payload)
+                            || std::memcmp(written.constData(), payload.constData(), size_t(payload.size())) == 0 ) {
+                        blobOffset = it.value().second;
+                        break;
+                    }
+                }
+                if( blobOffset < 0 ) {
+                    blobOffset = offset;
+                    blobs.insert(key, qMakePair(payloads.size(), offset));
+                    offset += payload.size();
+                    payloads.append(payload);
+                }
+
+                stream << e.mime() << quint8(BlobData) << blobOffset << payload.size();
+            }
+        }
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_2);
+    stream.writeRawData(s_dragSourceConfigHeadV02, sizeof(s_dragSourceConfigHeadV02));
+    stream << index;
+
+    for( const auto &payload : payloads ) {
+        if( file.write(payload.constData(), payload.size()) != payload.size() ) {
+            file.cancelWriting();
+            *errorString = tr("Save drag config: cannot write file");
+            return false;
+        }
+    }
+
+    if( ! file.commit() ) {
+        *errorString = tr("Save drag config: cannot write file");
+        return false;
+    }
+
+    return true;
+}
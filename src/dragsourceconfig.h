@@ -0,0 +1,42 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRAGSOURCECONFIG_H
+#define DRAGSOURCECONFIG_H
+
+#include <QString>
+
+class DragSourceModel;
+
+
+// Reading and writing of .dndtest drag source config files.
+//
+// Version 0.2 files start with an index of all entries, their actions, MIME
+// types and the offsets of their payloads in the data section that follows.
+// Loading only reads the index; payloads are mapped from the file when an
+// entry is actually used. Generated payloads are stored as their generator
+// spec instead of the data. Version 0.1 files are a plain QDataStream of the
+// whole model and are still read.
+namespace DragSourceConfig {
+
+bool load(const QString &fileName, DragSourceModel &model, QString *errorString);
+bool save(const QString &fileName, const DragSourceModel &model, QString *errorString);
+
+}
+
+#endif // DRAGSOURCECONFIG_H
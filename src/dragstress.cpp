@@ -0,0 +1,216 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dragstress.h"
+
+#include "dragsource.h"
+#include "droparea.h"
+#include "dropsimulator.h"
+#include "payloadmimedata.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QMimeData>
+#include <QTextStream>
+
+#include <memory>
+
+static const int s_memorySamples = 100;
+
+
+DragStress::DragStress(QObject *parent)
+    : QObject(parent)
+    , mMode(Drag)
+    , mIterations(1000)
+    , mPromiseMode(true)
+    , mGenerationDelay(0)
+    , mCancelled(false)
+    , mDone(0)
+    , mRetrieved(0)
+{
+}
+
+void DragStress::setMode(Mode mode)
+{
+    mMode = mode;
+}
+
+void DragStress::setIterations(int iterations)
+{
+    mIterations = qMax(1, iterations);
+}
+
+void DragStress::setPromiseMode(bool promise)
+{
+    mPromiseMode = promise;
+}
+
+void DragStress::setGenerationDelay(int msecs)
+{
+    mGenerationDelay = qMax(0, msecs);
+}
+
+void DragStress::cancel()
+{
+    mCancelled = true;
+}
+
+bool DragStress::run(const DnDAction &action)
+{
+    mCancelled = false;
+    mDone = 0;
+    mDeliver.clear();
+    mRetrieval.clear();
+    mActions.clear();
+    mRetrievedPerDrag.clear();
+    mMemory.clear();
+
+    DragSource source;
+    source.setData(action);
+    source.setPromiseMode(mPromiseMode);
+    source.setGenerationDelay(mGenerationDelay);
+
+    DropArea target;
+    target.setAttribute(Qt::WA_DontShowOnScreen);
+    target.resize(200, 200);
+    if( mMode == Drag )
+        target.show();
+
+    int capturedAction = Qt::IgnoreAction;
+    QObject::connect(&target, &DropArea::dataDropped, [&](int dropAction, const DnDAction &) {
+        capturedAction = dropAction;
+    });
+
+    const int sampleEvery = qMax(1, mIterations / s_memorySamples);
+    sampleMemory(0);
+
+    QElapsedTimer timer;
+    for( int i = 0; i < mIterations && ! mCancelled; ++i ) {
+        capturedAction = Qt::IgnoreAction;
+        mRetrieved = 0;
+
+        QMimeData *mimeData = source.toNewMimeData();
+        if( auto *payloadData = qobject_cast<PayloadMimeData *>(mimeData) ) {
+            connect(payloadData, &PayloadMimeData::formatRetrieved, this,
+                    [this](const QString &mimeType, qint64, qint64 nsecs) {
+                mRetrieval[mimeType].record(nsecs);
+                ++mRetrieved;
+            });
+        }
+
+        timer.start();
+        if( mMode == Clipboard ) {
+            QApplication::clipboard()->setMimeData(mimeData);
+            target.fromClipboard();
+        } else {
+            std::unique_ptr<QMimeData> owner(mimeData);
+            capturedAction = DropSimulator::drop(&target, mimeData, action.supportedActions);
+        }
+        mDeliver.record(timer.nsecsElapsed());
+
+        ++mActions[DropDataModel::actionString(capturedAction)];
+        mRetrievedPerDrag.record(mRetrieved);
+        ++mDone;
+
+        if( mDone % sampleEvery == 0 )
+            sampleMemory(mDone);
+        emit progress(mDone, mIterations);
+        QApplication::processEvents();
+    }
+
+    if( mMemory.last().first != mDone )
+        sampleMemory(mDone);
+    if( mMode == Clipboard )
+        QApplication::clipboard()->clear();
+
+    return ! mCancelled;
+}
+
+const LatencyHistogram &DragStress::deliverLatency() const
+{
+    return mDeliver;
+}
+
+QJsonObject DragStress::toJson() const
+{
+    QJsonObject o;
+    o["mode"] = mMode == Clipboard ? QStringLiteral("clipboard") : QStringLiteral("drag");
+    o["promise"] = mPromiseMode;
+    o["generationDelayMs"] = mGenerationDelay;
+    o["iterations"] = mDone;
+    o["cancelled"] = mCancelled;
+    o["deliver"] = mDeliver.toJson();
+
+    QJsonObject actions;
+    for( auto it = mActions.cbegin(); it != mActions.cend(); ++it )
+        actions[it.key()] = it.value();
+    o["actions"] = actions;
+
+    QJsonObject retrieval;
+    for( auto it = mRetrieval.cbegin(); it != mRetrieval.cend(); ++it )
+        retrieval[it.key()] = it.value().toJson();
+    o["retrieval"] = retrieval;
+    o["meanFormatsRetrieved"] = mRetrievedPerDrag.mean();
+
+    QJsonArray memory;
+    for( const auto &m : mMemory ) {
+        QJsonObject s;
+        s["iteration"] = m.first;
+        s["residentBytes"] = m.second < 0 ? QJsonValue() : QJsonValue(double(m.second));
+        memory.append(s);
+    }
+    o["memory"] = memory;
+
+    return o;
+}
+
+void DragStress::writeCsv(QIODevice *device) const
+{
+    QTextStream out(device);
+    LatencyHistogram::writeCsvHeader(out);
+    mDeliver.writeCsv(out, QStringLiteral("deliver"));
+    for( auto it = mRetrieval.cbegin(); it != mRetrieval.cend(); ++it )
+        it.value().writeCsv(out, QStringLiteral("retrieve %1").arg(it.key()));
+}
+
+void DragStress::sampleMemory(int iteration)
+{
+    mMemory.append(qMakePair(iteration, residentBytes()));
+}
+
+// Only Linux exposes this without platform specific API.
+qint64 DragStress::residentBytes()
+{
+    QFile status(QStringLiteral("/proc/self/status"));
+    if( ! status.open(QIODevice::ReadOnly | QIODevice::Text) )
+        return -1;
+
+    const QList<QByteArray> lines = status.readAll().split('\n');
+    for( const auto &line : lines ) {
+        if( ! line.startsWith("VmRSS:") )
+            continue;
+
+        const QList<QByteArray> fields = line.mid(6).simplified().split(' ');
+        bool ok = false;
+        const qint64 kib = fields.value(0).toLongLong(&ok);
+        return ok ? kib * 1024 : -1;
+    }
+    return -1;
+}
@@ -0,0 +1,94 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DRAGSTRESS_H
+#define DRAGSTRESS_H
+
+#include "dndaction.h"
+#include "latencyhistogram.h"
+
+#include <QJsonObject>
+#include <QMap>
+#include <QObject>
+#include <QPair>
+
+class QIODevice;
+
+
+// Repeats a drag source entry thousands of times against an in-process
+// DropArea, either as simulated drags or through the clipboard, to
+// characterise latency tails and memory growth of the Qt drag and drop
+// stack. A real QDrag::exec() needs platform input to finish, so drags are
+// delivered as the events it would produce, see DropSimulator.
+//
+// The target reads every format through QMimeData, so in promise mode each
+// retrieval is recorded per format.
+class DragStress : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Drag,
+        Clipboard
+    };
+
+    explicit DragStress(QObject *parent = 0);
+
+    void setMode(Mode mode);
+    void setIterations(int iterations);
+    void setPromiseMode(bool promise);
+    void setGenerationDelay(int msecs);
+
+    // Processes events between iterations; returns false if cancelled.
+    bool run(const DnDAction &action);
+
+    // Time from handing the mime data over until the target has read it;
+    // simulated delivery, not QDrag::exec().
+    const LatencyHistogram &deliverLatency() const;
+    QJsonObject toJson() const;
+    void writeCsv(QIODevice *device) const;
+
+signals:
+    void progress(int done, int total);
+
+public slots:
+    void cancel();
+
+private:
+    void sampleMemory(int iteration);
+    static qint64 residentBytes();
+
+    Mode mMode;
+    int mIterations;
+    bool mPromiseMode;
+    int mGenerationDelay;
+    bool mCancelled;
+
+    int mDone;
+    LatencyHistogram mDeliver;
+    QMap<QString, LatencyHistogram> mRetrieval;
+    QMap<QString, int> mActions;
+    // Formats retrieved during the current iteration; clipboard data can
+    // still be asked for after it, that counts towards the next one.
+    int mRetrieved;
+    LatencyHistogram mRetrievedPerDrag;
+    // Resident set size by iteration, -1 where the platform does not tell.
+    QVector<QPair<int, qint64>> mMemory;
+};
+
+#endif // DRAGSTRESS_H
@@ -18,20 +18,178 @@
 
 #include "droparea.h"
 
+#include "payloadmimedata.h"
+
 #include <QApplication>
+#include <QBuffer>
 #include <QClipboard>
-#include <QCryptographicHash>
 #include <QDebug>
 #include <QDragEnterEvent>
+#include <QHash>
+#include <QImage>
 #include <QMimeData>
 #include <QMimeDatabase>
 #include <QMouseEvent>
+#include <QMutex>
+#include <QPointer>
+#include <QRunnable>
 #include <QTimer>
+#include <QWaitCondition>
 
 static const int s_FromClipboardAction = -1;
+static const qint64 s_syncHashLimit = 64 * 1024;
+static const int s_monitorCoalesceMsecs = 100;
+static const char s_qtImageMime[] = "application/x-qt-image";
+
+namespace {
+
+// Lazily serves formats from a QMimeData for as long as it is alive. For
+// clipboard data the source is also invalidated when the clipboard changes,
+// as the platform mime data object is reused for the new owner.
+class MimeDataSource : public QObject, public PayloadSource
+{
+public:
+    explicit MimeDataSource(const QMimeData *mimeData)
+        : mMimeData(const_cast<QMimeData *>(mimeData))
+        , mValid(true)
+    {
+    }
+
+    MimeDataSource(const QMimeData *mimeData, QClipboard::Mode mode)
+        : MimeDataSource(mimeData)
+    {
+        connect(QApplication::clipboard(), &QClipboard::changed, this, [this, mode](QClipboard::Mode changed) {
+            if( changed == mode )
+                mValid = false;
+        });
+    }
+
+    bool isAvailable() const override
+    {
+        return mValid && mMimeData;
+    }
+
+    Payload fetch(const QString &mime) override
+    {
+        if( ! isAvailable() )
+            return Payload();
+        return Payload::fromHeap(mMimeData->data(mime));
+    }
+
+private:
+    QPointer<QMimeData> mMimeData;
+    bool mValid;
+};
+
+// Result of a format conversion running on the conversion pool. A drop waits
+// for it until the format deadline; if that passes, the entry is served from
+// here once the conversion is done.
+class ConversionSource : public PayloadSource
+{
+public:
+    ConversionSource()
+        : mDone(false)
+        , mNsecs(-1)
+    {
+    }
+
+    void finish(const QByteArray &bytes, qint64 nsecs)
+    {
+        QMutexLocker lock(&mMutex);
+        mBytes = bytes;
+        mNsecs = nsecs;
+        mDone = true;
+        mFinished.wakeAll();
+    }
+
+    // Negative msecs wait without limit.
+    bool wait(qint64 msecs)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QMutexLocker lock(&mMutex);
+        while( ! mDone ) {
+            if( msecs < 0 ) {
+                mFinished.wait(&mMutex);
+                continue;
+            }
+            const qint64 remaining = msecs - timer.elapsed();
+            if( remaining <= 0 )
+                break;
+            mFinished.wait(&mMutex, ulong(remaining));
+        }
+        return mDone;
+    }
+
+    QByteArray bytes() const
+    {
+        QMutexLocker lock(&mMutex);
+        return mBytes;
+    }
+
+    qint64 nsecs() const
+    {
+        QMutexLocker lock(&mMutex);
+        return mNsecs;
+    }
+
+    bool isAvailable() const override
+    {
+        return true;
+    }
+
+    Payload fetch(const QString &) override
+    {
+        wait(-1);
+        return Payload::fromHeap(bytes());
+    }
+
+private:
+    mutable QMutex mMutex;
+    QWaitCondition mFinished;
+    bool mDone;
+    QByteArray mBytes;
+    qint64 mNsecs;
+};
+
+// Encodes an image snapshot the way QMimeData::data() does for
+// application/x-qt-image, without holding up the GUI thread.
+class ImageConversionJob : public QRunnable
+{
+public:
+    ImageConversionJob(const QImage &image, const QSharedPointer<ConversionSource> &result)
+        : mImage(image), mResult(result)
+    {
+    }
+
+    void run() override
+    {
+        QElapsedTimer timer;
+        timer.start();
+        QByteArray bytes;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        mImage.save(&buffer, "PNG");
+        mResult->finish(bytes, timer.nsecsElapsed());
+    }
+
+private:
+    QImage mImage;
+    QSharedPointer<ConversionSource> mResult;
+};
+
+}
+
 
 DropArea::DropArea(QWidget *parent)
     : QLabel(parent)
+    , mLazyFetch(false)
+    , mPayloadHandOver(false)
+    , mAcceptedActions(Qt::CopyAction | Qt::MoveAction | Qt::LinkAction)
+    , mFormatDeadline(0)
+    , mMoveEvents(0)
+    , mMoveEventsCached(0)
+    , mMonitorClipboard(false)
 {
     setAcceptDrops(true);
     setAutoFillBackground(true);
@@ -44,16 +202,71 @@ void DropArea::setDropActionString(const QString &dropAction)
     setText(tr("<drop content>\n(%1)").arg(dropAction));
 }
 
+bool DropArea::lazyFetch() const
+{
+    return mLazyFetch;
+}
+
+void DropArea::setLazyFetch(bool lazy)
+{
+    mLazyFetch = lazy;
+}
+
+bool DropArea::payloadHandOver() const
+{
+    return mPayloadHandOver;
+}
+
+void DropArea::setPayloadHandOver(bool handOver)
+{
+    mPayloadHandOver = handOver;
+}
+
+Qt::DropActions DropArea::acceptedActions() const
+{
+    return mAcceptedActions;
+}
+
+void DropArea::setAcceptedActions(Qt::DropActions actions)
+{
+    mAcceptedActions = actions;
+    mAcceptDecision.valid = false;
+}
+
+int DropArea::formatDeadline() const
+{
+    return mFormatDeadline;
+}
+
+void DropArea::setFormatDeadline(int msecs)
+{
+    mFormatDeadline = msecs;
+}
+
 void DropArea::dragEnterEvent(QDragEnterEvent *event)
 {
     setBackgroundRole(QPalette::Highlight);
+    mDragTimer.start();
+    mAcceptDecision.valid = false;
+    mMoveEvents = 0;
+    mMoveEventsCached = 0;
 
     acceptDropEvent(event);
 }
 
+// The answer covers the whole label, so the platform can stop sending moves
+// while the cursor stays inside. Modifier changes then only show in the
+// cursor after leaving it, the drop itself always uses the current ones.
 void DropArea::dragMoveEvent(QDragMoveEvent *event)
 {
-    acceptDropEvent(event);
+    ++mMoveEvents;
+    if( acceptDropEvent(event) )
+        ++mMoveEventsCached;
+
+    if( event->isAccepted() )
+        event->accept(rect());
+    else
+        event->ignore(rect());
 }
 
 void DropArea::dragLeaveEvent(QDragLeaveEvent *)
@@ -67,18 +280,27 @@ void DropArea::dropEvent(QDropEvent *event)
     act.defaultAction = event->proposedAction();
     act.supportedActions = event->possibleActions();
 
+    DropTimings timings;
+    timings.origin = event->source() ? QStringLiteral("local drop") : QStringLiteral("drop");
+    if( mDragTimer.isValid() ) {
+        timings.enterToDropNsecs = mDragTimer.nsecsElapsed();
+        timings.moveEvents = mMoveEvents;
+        timings.moveEventsCached = mMoveEventsCached;
+    }
+    mDragTimer.invalidate();
+
     acceptDropEvent(event);
 
-    const QMimeData *mimeData = event->mimeData();
-    const QStringList formats = mimeData->formats();
-    act.data.reserve(formats.size());
+    // Data of drops from other applications is only available during the
+    // drop event, so only drags from within this process are fetched lazily.
+    QSharedPointer<PayloadSource> source;
+    if( mLazyFetch && event->source() )
+        source.reset(new MimeDataSource(event->mimeData()));
 
     qDebug() << "Drop (" << event->dropAction() << "):";
-    for( const auto &f : formats) {
-        qDebug() << " format: " << f;
-        act.data.append(DnDAction::DataEntry(f, mimeData->data(f)));
-    }
+    readFormats(event->mimeData(), source, mLazyFetch, act, timings);
 
+    emit dropMeasured(timings);
     emit dataDropped(event->dropAction(), act);
 
     clear();
@@ -107,39 +329,270 @@ void DropArea::mouseReleaseEvent(QMouseEvent *)
 void DropArea::fromClipboard()
 {
     DnDAction act;
+    DropTimings timings;
+    readClipboard(QClipboard::Clipboard, mLazyFetch, act, timings);
+
+    emit dropMeasured(timings);
+    emit dataDropped(s_FromClipboardAction, act);
+
+    clear();
+}
+
+bool DropArea::monitorClipboard() const
+{
+    return mMonitorClipboard;
+}
+
+void DropArea::setMonitorClipboard(bool monitor)
+{
+    if( monitor == mMonitorClipboard )
+        return;
+
+    mMonitorClipboard = monitor;
+    QClipboard *clipboard = QApplication::clipboard();
+    if( monitor ) {
+        connect(clipboard, &QClipboard::changed, this, &DropArea::onClipboardChanged);
+    } else {
+        disconnect(clipboard, &QClipboard::changed, this, &DropArea::onClipboardChanged);
+        for( auto &m : mMonitors ) {
+            if( m.timer )
+                m.timer->stop();
+            m.pending = 0;
+            m.last = DnDAction();
+        }
+    }
+}
+
+void DropArea::onClipboardChanged(QClipboard::Mode mode)
+{
+    ClipboardMonitor &m = mMonitors[mode];
+    ++m.pending;
+
+    // Fixed window instead of restarting on every change, so that even a
+    // steady stream of changes gets sampled.
+    if( ! m.timer ) {
+        m.timer = new QTimer(this);
+        m.timer->setSingleShot(true);
+        m.timer->setInterval(s_monitorCoalesceMsecs);
+        connect(m.timer, &QTimer::timeout, this, [this, mode]() { captureMonitoredClipboard(mode); });
+    }
+    if( ! m.timer->isActive() )
+        m.timer->start();
+}
+
+void DropArea::captureMonitoredClipboard(QClipboard::Mode mode)
+{
+    ClipboardMonitor &m = mMonitors[mode];
+    const int changes = m.pending;
+    m.pending = 0;
+
+    DnDAction act;
+    DropTimings timings;
+    readClipboard(mode, true, act, timings);
+
+    if( isUnchanged(m.last, act) ) {
+        emit clipboardMonitored(timings.origin, changes, false);
+        return;
+    }
+    m.last = act;
+
+    emit clipboardMonitored(timings.origin, changes, true);
+    emit dropMeasured(timings);
+    emit dataDropped(s_FromClipboardAction, act);
+}
+
+void DropArea::readClipboard(QClipboard::Mode mode, bool lazy, DnDAction &act, DropTimings &timings)
+{
     act.defaultAction = Qt::CopyAction;
     act.supportedActions = Qt::CopyAction;
 
-    const QMimeData *mimeData = QApplication::clipboard()->mimeData();
+    switch( mode ) {
+    case QClipboard::Clipboard: timings.origin = QStringLiteral("clipboard"); break;
+    case QClipboard::Selection: timings.origin = QStringLiteral("selection"); break;
+    case QClipboard::FindBuffer: timings.origin = QStringLiteral("find buffer"); break;
+    }
+
+    const QMimeData *mimeData = QApplication::clipboard()->mimeData(mode);
+    if( ! mimeData )
+        return;
+
+    QSharedPointer<PayloadSource> source;
+    if( lazy )
+        source.reset(new MimeDataSource(mimeData, mode));
+
+    readFormats(mimeData, source, lazy, act, timings);
+}
+
+// Cheap check of the format lists first. The previous data is gone if it was
+// not fetched before the change, so only fully fetched captures are compared.
+// Then the new formats are fetched and compared by content key; they stay
+// fetched, so the next change can be compared against them.
+bool DropArea::isUnchanged(const DnDAction &last, const DnDAction &act)
+{
+    if( last.data.size() != act.data.size() || act.data.isEmpty() )
+        return false;
+
+    for( int i = 0; i < act.data.size(); ++i ) {
+        if( last.data.at(i).mime() != act.data.at(i).mime() || ! last.data.at(i).isFetched() )
+            return false;
+    }
+
+    bool unchanged = true;
+    for( int i = 0; i < act.data.size(); ++i ) {
+        const auto &a = act.data.at(i);
+        if( ! a.isAvailable() )
+            return false;
+
+        if( last.data.at(i).payload().contentKey() != a.payload().contentKey() )
+            unchanged = false;
+    }
+
+    return unchanged;
+}
+
+// The format list is snapshotted once. Conversions are started on the pool
+// first, so they overlap with reading the formats that are already encoded;
+// a conversion that misses the deadline leaves its entry to be fetched
+// later instead of stalling the drop.
+void DropArea::readFormats(const QMimeData *mimeData, const QSharedPointer<PayloadSource> &source,
+                           bool lazy, DnDAction &act, DropTimings &timings)
+{
+    QElapsedTimer timer;
+    timer.start();
     const QStringList formats = mimeData->formats();
-    act.data.reserve(formats.size());
+    timings.formatsNsecs = timer.nsecsElapsed();
+    if( mFormatDeadline > 0 )
+        timings.formatDeadlineNsecs = mFormatDeadline * qint64(1000000);
 
-    for( const auto &f : formats)
-        act.data.append(DnDAction::DataEntry(f, mimeData->data(f)));
+    act.data.resize(formats.size());
+    timings.formats.resize(formats.size());
 
-    emit dataDropped(s_FromClipboardAction, act);
+    // Drags from our own drag sources may hand over their payloads directly.
+    const auto *payloadData = mPayloadHandOver ? qobject_cast<const PayloadMimeData *>(mimeData) : nullptr;
 
-    clear();
+    QVector<QSharedPointer<ConversionSource>> conversions(formats.size());
+    QVector<qint64> snapshotNsecs(formats.size(), 0);
+    QElapsedTimer conversionTimer;
+    conversionTimer.start();
+    if( ! payloadData && ! source ) {
+        for( int i = 0; i < formats.size(); ++i ) {
+            if( ! isConversion(formats.at(i)) )
+                continue;
+
+            timer.restart();
+            const QImage image = qvariant_cast<QImage>(mimeData->imageData());
+            snapshotNsecs[i] = timer.nsecsElapsed();
+            if( image.isNull() )
+                continue;
+
+            conversions[i].reset(new ConversionSource);
+            mConversionPool.start(new ImageConversionJob(image, conversions.at(i)));
+        }
+    }
+
+    for( int i = 0; i < formats.size(); ++i ) {
+        const QString &f = formats.at(i);
+        qDebug() << " format: " << f;
+        DropTimings::Format &ft = timings.formats[i];
+        ft.mime = f;
+
+        if( payloadData ) {
+            const auto entry = payloadData->entries().at(i).cachingEntry();
+            if( ! lazy ) {
+                timer.restart();
+                ft.bytes = entry.payload().size();
+                ft.fetchNsecs = timer.nsecsElapsed();
+            }
+            act.data[i] = entry;
+        } else if( source ) {
+            act.data[i] = DnDAction::DataEntry(f, source);
+        } else if( ! conversions.at(i) ) {
+            timer.restart();
+            const QByteArray bytes = mimeData->data(f);
+            ft.fetchNsecs = timer.nsecsElapsed();
+            ft.bytes = bytes.size();
+            ft.timedOut = timings.formatDeadlineNsecs >= 0 && ft.fetchNsecs > timings.formatDeadlineNsecs;
+            act.data[i] = DnDAction::DataEntry(f, bytes);
+        }
+    }
+
+    // Deadlines run from when the conversions were started, so they do not
+    // add up and time spent on the other formats counts towards them.
+    for( int i = 0; i < formats.size(); ++i ) {
+        const auto &conversion = conversions.at(i);
+        if( ! conversion )
+            continue;
+
+        DropTimings::Format &ft = timings.formats[i];
+        ft.converted = true;
+        const qint64 remaining = mFormatDeadline > 0 ? qMax<qint64>(0, mFormatDeadline - conversionTimer.elapsed()) : -1;
+        if( ! conversion->wait(remaining) ) {
+            ft.timedOut = true;
+            act.data[i] = DnDAction::DataEntry(ft.mime, conversion);
+            continue;
+        }
+
+        const QByteArray bytes = conversion->bytes();
+        ft.fetchNsecs = snapshotNsecs.at(i) + conversion->nsecs();
+        ft.bytes = bytes.size();
+        act.data[i] = DnDAction::DataEntry(ft.mime, bytes);
+    }
 }
 
-void DropArea::acceptDropEvent(QDropEvent *event)
+// Formats Qt synthesizes from a typed value on every data() call; the value
+// itself is cheap to snapshot, the encoding is not.
+bool DropArea::isConversion(const QString &mime)
 {
-    const auto override = overrideAction(event->keyboardModifiers());
+    return mime == QLatin1String(s_qtImageMime);
+}
 
-    switch (override) {
-    case Qt::CopyAction:
-    case Qt::MoveAction:
-    case Qt::LinkAction:
-        if( event->possibleActions() & override ) {
-            event->setDropAction(override);
-            event->accept();
-        } else {
-            event->ignore();
+bool DropArea::acceptDropEvent(QDropEvent *event)
+{
+    AcceptDecision &d = mAcceptDecision;
+    const bool cached = d.valid
+            && d.modifiers == event->keyboardModifiers()
+            && d.possibleActions == event->possibleActions()
+            && d.proposedAction == event->proposedAction();
+
+    if( ! cached ) {
+        d.valid = true;
+        d.modifiers = event->keyboardModifiers();
+        d.possibleActions = event->possibleActions();
+        d.proposedAction = event->proposedAction();
+
+        const auto override = overrideAction(d.modifiers);
+        switch (override) {
+        case Qt::CopyAction:
+        case Qt::MoveAction:
+        case Qt::LinkAction:
+            d.accept = d.possibleActions.testFlag(override) && mAcceptedActions.testFlag(override);
+            d.dropAction = override;
+            break;
+        default:
+            d.accept = true;
+            d.dropAction = d.proposedAction;
+            if( ! mAcceptedActions.testFlag(d.dropAction) ) {
+                const Qt::DropActions usable = d.possibleActions & mAcceptedActions;
+                d.accept = false;
+                for( const auto a : {Qt::CopyAction, Qt::MoveAction, Qt::LinkAction} ) {
+                    if( usable.testFlag(a) ) {
+                        d.accept = true;
+                        d.dropAction = a;
+                        break;
+                    }
+                }
+            }
         }
-        break;
-    default:
-        event->acceptProposedAction();
     }
+
+    if( d.accept ) {
+        event->setDropAction(d.dropAction);
+        event->accept();
+    } else {
+        event->ignore();
+    }
+
+    return cached;
 }
 
 Qt::DropAction DropArea::overrideAction(Qt::KeyboardModifiers modifiers)
@@ -167,12 +620,27 @@ void DropArea::clear()
 DropDataModel::DropDataModel(QObject *parent)
     : QAbstractItemModel(parent)
     , mDropAction(-2)
+    , mHashAlgorithm(ChunkedHash::Sha1)
+    , mNextHashId(0)
+    , mNextDecodeId(0)
+    , mInternId(-1)
+    , mNextInternId(0)
+    , mLastResetNsecs(-1)
 {
+    connect(&mHasher, &PayloadHasher::hashed, this, &DropDataModel::onHashed);
+    connect(&mDecoder, &PayloadDecoderPipeline::decoded, this, &DropDataModel::onDecoded);
+    connect(&mInterner, &PayloadInterner::interned, this, &DropDataModel::onInterned);
+    MemoryAccounting::instance().setProvider(this, tr("Drop data"), [this]() { return holdings(); });
+}
+
+DropDataModel::~DropDataModel()
+{
+    MemoryAccounting::instance().release(this);
 }
 
 int DropDataModel::columnCount(const QModelIndex &) const
 {
-    return 4;
+    return 7;
 }
 
 QVariant DropDataModel::data(const QModelIndex &index, int role) const
@@ -189,9 +657,21 @@ QVariant DropDataModel::data(const QModelIndex &index, int role) const
     case 1:
         return dropFileExtension(index.row());
     case 2:
+        if( mDrop.data.at(index.row()).fileSize() < 0 )
+            return tr("?");
         return mDrop.data.at(index.row()).fileSize();
     case 3:
-        return mDrop.data.at(index.row()).sha1();
+        if( ! mDrop.data.at(index.row()).isFetched() )
+            return mDrop.data.at(index.row()).isAvailable() ? tr("not fetched") : tr("unavailable");
+        return mDigests.at(index.row()).isEmpty() ? tr("hashing...") : mDigests.at(index.row());
+    case 4:
+        if( mDecodeIds.at(index.row()) >= 0 )
+            return tr("decoding...");
+        return mDecoded.at(index.row()).kind;
+    case 5:
+        return mDecoded.at(index.row()).charset;
+    case 6:
+        return mDecoded.at(index.row()).details;
     }
 
     return {};
@@ -218,7 +698,13 @@ QVariant DropDataModel::headerData(int section, Qt::Orientation orientation, int
     case 2:
         return tr("Bytes");
     case 3:
-        return tr("SHA-1");
+        return ChunkedHash::name(mHashAlgorithm);
+    case 4:
+        return tr("Content");
+    case 5:
+        return tr("Charset");
+    case 6:
+        return tr("Details");
     }
 
     return {};
@@ -239,9 +725,37 @@ QByteArray DropDataModel::dropData(int row) const
     return mDrop.data.at(row).bytes();
 }
 
+Payload DropDataModel::dropPayload(int row) const
+{
+    return mDrop.data.at(row).payload();
+}
+
+void DropDataModel::fetch(int row)
+{
+    const auto &e = mDrop.data.at(row);
+    if( e.isFetched() )
+        return;
+
+    if( e.isAvailable() ) {
+        QElapsedTimer timer;
+        timer.start();
+        const Payload payload = e.payload();
+        emit rowFetched(row, timer.nsecsElapsed(), payload.size());
+        hashRow(row, payload);
+        decodeRow(row, payload);
+        internRows();
+    }
+    emit dataChanged(index(row, 0, {}), index(row, columnCount() - 1, {}));
+}
+
 QString DropDataModel::dropActioString() const
 {
-    switch( mDropAction ) {
+    return actionString(mDropAction);
+}
+
+QString DropDataModel::actionString(int dropAction)
+{
+    switch( dropAction ) {
     case Qt::CopyAction: return tr("copy drop");
     case Qt::MoveAction: return tr("move drop");
     case Qt::LinkAction: return tr("link drop");
@@ -255,12 +769,257 @@ DnDAction DropDataModel::dropActionData() const
     return mDrop;
 }
 
+// Rows of formats that are still offered keep their place, selection and
+// digest; only added, removed or changed rows are signalled.
 void DropDataModel::setDropData(int dropAction, const DnDAction &data)
 {
-    beginResetModel();
+    QElapsedTimer timer;
+    timer.start();
+
     mDropAction = dropAction;
-    mDrop = data;
-    endResetModel();
+    mDrop.supportedActions = data.supportedActions;
+    mDrop.defaultAction = data.defaultAction;
+
+    // Pair old rows with new formats of the same MIME type, keeping the order.
+    QHash<QString, QList<int>> newRows;
+    for( int i = 0; i < data.data.size(); ++i )
+        newRows[data.data.at(i).mime()].append(i);
+
+    QVector<int> pairedWith(mDrop.data.size(), -1);
+    int lastPaired = -1;
+    for( int row = 0; row < mDrop.data.size(); ++row ) {
+        QList<int> &candidates = newRows[mDrop.data.at(row).mime()];
+        while( ! candidates.isEmpty() && candidates.first() <= lastPaired )
+            candidates.removeFirst();
+        if( ! candidates.isEmpty() )
+            lastPaired = pairedWith[row] = candidates.takeFirst();
+    }
+
+    for( int row = mDrop.data.size() - 1; row >= 0; --row ) {
+        if( pairedWith.at(row) >= 0 )
+            continue;
+
+        int first = row;
+        while( first > 0 && pairedWith.at(first - 1) < 0 )
+            --first;
+        removeEntryRange(first, row);
+        pairedWith.remove(first, row - first + 1);
+        row = first;
+    }
+
+    int row = 0;
+    for( int i = 0; i < data.data.size(); ) {
+        if( row < pairedWith.size() && pairedWith.at(row) == i ) {
+            const auto &e = data.data.at(i);
+            auto &current = mDrop.data[row];
+            const bool same = e.isFetched() == current.isFetched()
+                    && (e.isFetched() ? e.payload().isSharedWith(current.payload())
+                                      : e.source() == current.source());
+            if( ! same ) {
+                cancelRow(row);
+                current = e;
+                mDigests[row].clear();
+                mHashIds[row] = -1;
+                mDecoded[row] = PayloadDecoder::Info();
+                mDecodeIds[row] = -1;
+                if( e.isFetched() ) {
+                    hashRow(row, e.payload());
+                    decodeRow(row, e.payload());
+                }
+                emit dataChanged(index(row, 0, {}), index(row, columnCount() - 1, {}));
+            }
+            ++row;
+            ++i;
+            continue;
+        }
+
+        int end = i + 1;
+        while( end < data.data.size() && (row >= pairedWith.size() || pairedWith.at(row) != end) )
+            ++end;
+        insertEntries(row, data.data.mid(i, end - i));
+        pairedWith.insert(row, end - i, -1);
+        row += end - i;
+        i = end;
+    }
+
+    mLastResetNsecs = timer.nsecsElapsed();
+    internRows();
+    account();
+    emit dropDataChanged();
+}
+
+void DropDataModel::removeEntryRange(int first, int last)
+{
+    for( int row = first; row <= last; ++row )
+        cancelRow(row);
+
+    beginRemoveRows({}, first, last);
+    mDrop.data.remove(first, last - first + 1);
+    mDigests.remove(first, last - first + 1);
+    mHashIds.remove(first, last - first + 1);
+    mDecoded.remove(first, last - first + 1);
+    mDecodeIds.remove(first, last - first + 1);
+    endRemoveRows();
+}
+
+void DropDataModel::insertEntries(int row, const QVector<DnDAction::DataEntry> &entries)
+{
+    beginInsertRows({}, row, row + entries.size() - 1);
+    for( int i = 0; i < entries.size(); ++i ) {
+        mDrop.data.insert(row + i, entries.at(i));
+        mDigests.insert(row + i, QString());
+        mHashIds.insert(row + i, -1);
+        mDecoded.insert(row + i, PayloadDecoder::Info());
+        mDecodeIds.insert(row + i, -1);
+    }
+    endInsertRows();
+
+    for( int i = row; i < row + entries.size(); ++i ) {
+        if( mDrop.data.at(i).isFetched() ) {
+            hashRow(i, mDrop.data.at(i).payload());
+            decodeRow(i, mDrop.data.at(i).payload());
+        }
+    }
+}
+
+ChunkedHash::Algorithm DropDataModel::hashAlgorithm() const
+{
+    return mHashAlgorithm;
+}
+
+qint64 DropDataModel::lastResetNsecs() const
+{
+    return mLastResetNsecs;
+}
+
+void DropDataModel::setHashAlgorithm(ChunkedHash::Algorithm algorithm)
+{
+    if( mHashAlgorithm == algorithm )
+        return;
+
+    mHashAlgorithm = algorithm;
+    rehash();
+    emit headerDataChanged(Qt::Horizontal, 3, 3);
+    if( ! mDrop.data.isEmpty() )
+        emit dataChanged(index(0, 3, {}), index(mDrop.data.size() - 1, 3, {}));
+}
+
+void DropDataModel::rehash()
+{
+    mHasher.cancelAll();
+
+    mDigests.fill(QString(), mDrop.data.size());
+    mHashIds.fill(-1, mDrop.data.size());
+    for( int row = 0; row < mDrop.data.size(); ++row ) {
+        if( mDrop.data.at(row).isFetched() )
+            hashRow(row, mDrop.data.at(row).payload());
+    }
+}
+
+void DropDataModel::hashRow(int row, const Payload &payload)
+{
+    if( payload.size() > s_syncHashLimit ) {
+        mHashIds[row] = mNextHashId++;
+        mHasher.hash(mHashIds.at(row), payload, mHashAlgorithm);
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    mDigests[row] = ChunkedHash::hexDigest(mHashAlgorithm, payload);
+    emit rowHashed(row, timer.nsecsElapsed());
+}
+
+// Stops the background work for a row that is replaced or removed, so it
+// does not keep the old payload alive.
+void DropDataModel::cancelRow(int row)
+{
+    if( mHashIds.at(row) >= 0 )
+        mHasher.cancel(mHashIds.at(row));
+    if( mDecodeIds.at(row) >= 0 )
+        mDecoder.cancel(mDecodeIds.at(row));
+}
+
+void DropDataModel::onHashed(int id, const QString &digest, qint64 nsecs)
+{
+    const int row = mHashIds.indexOf(id);
+    if( row < 0 )
+        return;
+
+    mHashIds[row] = -1;
+    mDigests[row] = digest;
+    emit dataChanged(index(row, 3, {}), index(row, 3, {}));
+    emit rowHashed(row, nsecs);
+}
+
+// Decoders skip what they do not need, so this is always asynchronous.
+void DropDataModel::decodeRow(int row, const Payload &payload)
+{
+    if( ! PayloadDecoder::canDecode(mDrop.data.at(row).mime()) )
+        return;
+
+    mDecodeIds[row] = mNextDecodeId++;
+    mDecoder.decode(mDecodeIds.at(row), mDrop.data.at(row).mime(), payload);
+}
+
+void DropDataModel::onDecoded(int id, const PayloadDecoder::Info &info, qint64 nsecs)
+{
+    const int row = mDecodeIds.indexOf(id);
+    if( row < 0 )
+        return;
+
+    mDecodeIds[row] = -1;
+    mDecoded[row] = info;
+    emit dataChanged(index(row, 4, {}), index(row, 6, {}));
+    emit rowDecoded(row, nsecs);
+}
+
+// Drops arrive on the heap. Interning spills the large payloads and shares
+// the ones held elsewhere; the rows are switched over once that is done, the
+// data does not change.
+void DropDataModel::internRows()
+{
+    if( mInternId >= 0 )
+        mInterner.cancel(mInternId);
+
+    mInterning = mDrop;
+    mInternId = mNextInternId++;
+    mInterner.intern(mInternId, mInterning);
+}
+
+void DropDataModel::onInterned(int id, const DnDAction &action)
+{
+    if( id != mInternId )
+        return;
+
+    mInternId = -1;
+    for( int i = 0; i < action.data.size(); ++i ) {
+        const auto &old = mInterning.data.at(i);
+        if( ! old.isFetched() || action.data.at(i).payload().isSharedWith(old.payload()) )
+            continue;
+
+        for( auto &e : mDrop.data ) {
+            if( e.isFetched() && e.payload().isSharedWith(old.payload()) )
+                e = action.data.at(i);
+        }
+    }
+    mInterning = DnDAction();
+    account();
+}
+
+void DropDataModel::account()
+{
+    MemoryAccounting::instance().refresh(this);
+}
+
+QVector<MemoryAccounting::Holding> DropDataModel::holdings() const
+{
+    QVector<MemoryAccounting::Holding> holdings;
+    for( const auto &e : mDrop.data ) {
+        if( e.isFetched() )
+            holdings.append(MemoryAccounting::Holding::of(e.payload()));
+    }
+    return holdings;
 }
 
 QModelIndex DropDataModel::index(int row, int column, const QModelIndex &parent) const
@@ -20,10 +20,20 @@
 #define DROPAREA_H
 
 #include <QAbstractItemModel>
+#include <QClipboard>
+#include <QElapsedTimer>
 #include <QLabel>
+#include <QThreadPool>
 
 #include "dndaction.h"
+#include "droptimings.h"
+#include "memoryaccounting.h"
+#include "payloaddecoder.h"
+#include "payloadhasher.h"
+#include "payloadinterner.h"
 
+class QMimeData;
+class QTimer;
 
 class DropArea : public QLabel {
     Q_OBJECT
@@ -33,8 +43,41 @@ public:
 
     void setDropActionString(const QString &dropAction);
 
+    bool lazyFetch() const;
+    void setLazyFetch(bool lazy);
+
+    // Drags from our own drag sources can hand over their payloads directly
+    // instead of going through QMimeData::data(). Off by default, as it
+    // bypasses the retrieval path that is usually what is being tested.
+    bool payloadHandOver() const;
+    void setPayloadHandOver(bool handOver);
+
+    // Drops are only accepted with one of these actions. Without an override
+    // modifier the proposed action is used if accepted, else the first
+    // accepted one the source supports.
+    Qt::DropActions acceptedActions() const;
+    void setAcceptedActions(Qt::DropActions actions);
+
+    // Time in milliseconds a drop waits for a format that has to be
+    // converted off the GUI thread; 0 waits without limit. Formats that miss
+    // it are marked as timed out and fetched when first needed.
+    int formatDeadline() const;
+    void setFormatDeadline(int msecs);
+
+    // Captures every clipboard, selection and find buffer change. Changes
+    // within a short window are coalesced, formats are read lazily and a
+    // capture equal to the previous one of the same mode is dropped.
+    bool monitorClipboard() const;
+    void setMonitorClipboard(bool monitor);
+
 signals:
+    void dropMeasured(const DropTimings &timings);
     void dataDropped(int dropAction, const DnDAction &data);
+    void clipboardMonitored(const QString &origin, int changes, bool captured);
+
+public slots:
+    // Captures the current clipboard contents like a drop.
+    void fromClipboard();
 
 protected:
     void dragEnterEvent(QDragEnterEvent *event) override;
@@ -48,12 +91,47 @@ protected:
     void mouseReleaseEvent(QMouseEvent *) override;
 
 private slots:
-    void fromClipboard();
+    void onClipboardChanged(QClipboard::Mode mode);
 
 private:
+    // Accept decision for one combination of drag event inputs.
+    struct AcceptDecision {
+        bool valid = false;
+        Qt::KeyboardModifiers modifiers;
+        Qt::DropActions possibleActions;
+        Qt::DropAction proposedAction = Qt::IgnoreAction;
+        bool accept = false;
+        Qt::DropAction dropAction = Qt::IgnoreAction;
+    };
+
+    struct ClipboardMonitor {
+        QTimer *timer = nullptr;
+        int pending = 0;
+        DnDAction last;
+    };
+
     void clear();
-    void acceptDropEvent(QDropEvent *event);
+    void captureMonitoredClipboard(QClipboard::Mode mode);
+    void readClipboard(QClipboard::Mode mode, bool lazy, DnDAction &act, DropTimings &timings);
+    static bool isUnchanged(const DnDAction &last, const DnDAction &act);
+    void readFormats(const QMimeData *mimeData, const QSharedPointer<PayloadSource> &source,
+                     bool lazy, DnDAction &act, DropTimings &timings);
+    static bool isConversion(const QString &mime);
+    // Returns true if the cached decision was used.
+    bool acceptDropEvent(QDropEvent *event);
     static Qt::DropAction overrideAction(Qt::KeyboardModifiers modifiers);
+
+    bool mLazyFetch;
+    bool mPayloadHandOver;
+    Qt::DropActions mAcceptedActions;
+    int mFormatDeadline;
+    QThreadPool mConversionPool;
+    QElapsedTimer mDragTimer;
+    AcceptDecision mAcceptDecision;
+    int mMoveEvents;
+    int mMoveEventsCached;
+    bool mMonitorClipboard;
+    ClipboardMonitor mMonitors[QClipboard::LastMode + 1];
 };
 
 
@@ -62,6 +140,7 @@ class DropDataModel : public QAbstractItemModel {
 
 public:
     DropDataModel(QObject * parent = 0);
+    ~DropDataModel();
 
     QModelIndex index(int row, int column, const QModelIndex &parent) const;
     QModelIndex parent(const QModelIndex &child) const;
@@ -73,15 +152,60 @@ public:
     QString dropMimeType(int row) const;
     QString dropFileExtension(int row) const;
     QByteArray dropData(int row) const;
+    Payload dropPayload(int row) const;
+    void fetch(int row);
     QString dropActioString() const;
+    static QString actionString(int dropAction);
     DnDAction dropActionData() const;
 
+    ChunkedHash::Algorithm hashAlgorithm() const;
+    qint64 lastResetNsecs() const;
+
+signals:
+    void rowFetched(int row, qint64 nsecs, qint64 bytes);
+    void rowHashed(int row, qint64 nsecs);
+    void rowDecoded(int row, qint64 nsecs);
+    // Emitted after setDropData() updated the rows.
+    void dropDataChanged();
+
 public slots:
     void setDropData(int dropAction, const DnDAction &data);
+    void setHashAlgorithm(ChunkedHash::Algorithm algorithm);
+
+private slots:
+    void onHashed(int id, const QString &digest, qint64 nsecs);
+    void onDecoded(int id, const PayloadDecoder::Info &info, qint64 nsecs);
+    void onInterned(int id, const DnDAction &action);
 
 private:
+    void removeEntryRange(int first, int last);
+    void insertEntries(int row, const QVector<DnDAction::DataEntry> &entries);
+    void rehash();
+    void hashRow(int row, const Payload &payload);
+    void decodeRow(int row, const Payload &payload);
+    void cancelRow(int row);
+    void internRows();
+    void account();
+    QVector<MemoryAccounting::Holding> holdings() const;
+
     int mDropAction;
     DnDAction mDrop;
+    ChunkedHash::Algorithm mHashAlgorithm;
+    QVector<QString> mDigests;
+    // Hasher request of each row; rows move when formats are added or removed.
+    QVector<int> mHashIds;
+    int mNextHashId;
+    PayloadHasher mHasher;
+    QVector<PayloadDecoder::Info> mDecoded;
+    QVector<int> mDecodeIds;
+    int mNextDecodeId;
+    PayloadDecoderPipeline mDecoder;
+    // Rows as they were handed to the interner; at most one request runs.
+    DnDAction mInterning;
+    int mInternId;
+    int mNextInternId;
+    PayloadInterner mInterner;
+    qint64 mLastResetNsecs;
 };
 
 #endif // DROPAREA_H
@@ -0,0 +1,575 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "dropdiff.h"
+
+#include "memoryaccounting.h"
+
+#include <QHash>
+#include <QJsonArray>
+#include <QRunnable>
+#include <QtAlgorithms>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Offset of the first differing byte of a and b, or len if they are equal.
+static qint64 firstMismatch(const uchar *a, const uchar *b, qint64 len)
+{
+    qint64 i = 0;
+#ifdef __SSE2__
+    for( ; i + 16 <= len; i += 16 ) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        const unsigned int mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) ^ 0xffffu;
+        if( mask )
+            return i + qCountTrailingZeroBits(mask);
+    }
+#else
+    for( ; i + 8 <= len; i += 8 ) {
+        quint64 wa, wb;
+        std::memcpy(&wa, a + i, 8);
+        std::memcpy(&wb, b + i, 8);
+        if( wa != wb )
+            break;
+    }
+#endif
+    for( ; i < len; ++i ) {
+        if( a[i] != b[i] )
+            return i;
+    }
+    return len;
+}
+
+// Number of equal bytes at the ends of a and b, scanning backwards.
+static qint64 commonSuffix(const uchar *a, const uchar *b, qint64 len)
+{
+    qint64 n = 0;
+#ifdef __SSE2__
+    for( ; n + 16 <= len; n += 16 ) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a - n - 16));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b - n - 16));
+        const unsigned int mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) ^ 0xffffu;
+        if( mask )
+            return n + (15 - (31 - qCountLeadingZeroBits(quint32(mask))));
+    }
+#else
+    for( ; n + 8 <= len; n += 8 ) {
+        quint64 wa, wb;
+        std::memcpy(&wa, a - n - 8, 8);
+        std::memcpy(&wb, b - n - 8, 8);
+        if( wa != wb )
+            break;
+    }
+#endif
+    for( ; n < len; ++n ) {
+        if( a[-n - 1] != b[-n - 1] )
+            break;
+    }
+    return n;
+}
+
+static const quint64 s_rollingPrime = Q_UINT64_C(0x100000001b3);
+static const int s_filterBits = 20;
+
+static quint64 blockHash(const uchar *data, qint64 len)
+{
+    quint64 h = 0;
+    for( qint64 i = 0; i < len; ++i )
+        h = h * s_rollingPrime + data[i] + 1;
+    return h;
+}
+
+// About sqrt(len), so that both the index and the per block work stay small.
+static qint64 blockSizeFor(qint64 len)
+{
+    qint64 size = 64;
+    while( size * size < len && size < 64 * 1024 )
+        size *= 2;
+    return size;
+}
+
+static void addSegment(PayloadDiff &d, qint64 offset, qint64 length, qint64 source)
+{
+    if( length <= 0 )
+        return;
+
+    if( source < 0 )
+        d.literalBytes += length;
+    else
+        d.matchedBytes += length;
+
+    if( ! d.segments.isEmpty() ) {
+        PayloadDiff::Segment &last = d.segments.last();
+        const bool bothLiteral = last.source < 0 && source < 0;
+        const bool contiguous = last.source >= 0 && source == last.source + last.length;
+        if( bothLiteral || contiguous ) {
+            last.length += length;
+            return;
+        }
+    }
+
+    d.segments.append({offset, length, source});
+}
+
+// rsync style matching of b against the blocks of a: a rolling hash over b
+// is looked up in an index of a's block hashes, hits are verified and
+// extended in both directions with the vectorized scans.
+static bool matchBlocks(const uchar *a, qint64 aBegin, qint64 aEnd,
+                        const uchar *b, qint64 bBegin, qint64 bEnd,
+                        PayloadDiff &d, const QAtomicInt *cancel)
+{
+    const qint64 block = blockSizeFor(aEnd - aBegin);
+    d.blockSize = block;
+    if( aEnd - aBegin < block || bEnd - bBegin < block ) {
+        addSegment(d, bBegin, bEnd - bBegin, -1);
+        return true;
+    }
+
+    std::vector<std::pair<quint64, qint64>> index;
+    index.reserve(size_t((aEnd - aBegin) / block));
+    std::vector<bool> filter(size_t(1) << s_filterBits);
+    for( qint64 off = aBegin; off + block <= aEnd; off += block ) {
+        const quint64 h = blockHash(a + off, block);
+        index.emplace_back(h, off);
+        filter[size_t(h >> (64 - s_filterBits))] = true;
+    }
+    std::sort(index.begin(), index.end());
+
+    quint64 outFactor = 1;
+    for( qint64 i = 1; i < block; ++i )
+        outFactor *= s_rollingPrime;
+
+    qint64 pos = bBegin;
+    qint64 literalStart = bBegin;
+    quint64 h = blockHash(b + pos, block);
+    while( pos + block <= bEnd ) {
+        if( cancel && (pos & 0xfffff) == 0 && cancel->load() )
+            return false;
+
+        bool matched = false;
+        if( filter[size_t(h >> (64 - s_filterBits))] ) {
+            auto range = std::equal_range(index.begin(), index.end(), std::make_pair(h, qint64(-1)),
+                                          [](const std::pair<quint64, qint64> &x, const std::pair<quint64, qint64> &y) {
+                return x.first < y.first;
+            });
+            int candidates = 0;
+            for( auto it = range.first; it != range.second && candidates < 8; ++it, ++candidates ) {
+                const qint64 aOff = it->second;
+                if( firstMismatch(a + aOff, b + pos, block) != block )
+                    continue;
+
+                const qint64 forward = firstMismatch(a + aOff + block, b + pos + block,
+                                                     qMin(aEnd - aOff - block, bEnd - pos - block));
+                const qint64 back = commonSuffix(a + aOff, b + pos, qMin(pos - literalStart, aOff - aBegin));
+
+                addSegment(d, literalStart, pos - back - literalStart, -1);
+                addSegment(d, pos - back, back + block + forward, aOff - back);
+                pos += block + forward;
+                literalStart = pos;
+                if( pos + block <= bEnd )
+                    h = blockHash(b + pos, block);
+                matched = true;
+                break;
+            }
+        }
+
+        if( ! matched ) {
+            if( pos + block >= bEnd )
+                break;
+            h = (h - (quint64(b[pos]) + 1) * outFactor) * s_rollingPrime + b[pos + block] + 1;
+            ++pos;
+        }
+    }
+
+    addSegment(d, literalStart, bEnd - literalStart, -1);
+    return true;
+}
+
+static bool diffBytes(const uchar *a, qint64 na, const uchar *b, qint64 nb,
+                      PayloadDiff &d, const QAtomicInt *cancel)
+{
+    d.sizeA = na;
+    d.sizeB = nb;
+
+    const qint64 common = qMin(na, nb);
+    d.commonPrefix = firstMismatch(a, b, common);
+    if( d.commonPrefix == common && na == nb ) {
+        addSegment(d, 0, nb, 0);
+        return true;
+    }
+
+    d.firstMismatch = d.commonPrefix;
+    d.commonSuffix = commonSuffix(a + na, b + nb, common - d.commonPrefix);
+
+    addSegment(d, 0, d.commonPrefix, 0);
+    if( ! matchBlocks(a, d.commonPrefix, na - d.commonSuffix, b, d.commonPrefix, nb - d.commonSuffix, d, cancel) )
+        return false;
+    addSegment(d, nb - d.commonSuffix, d.commonSuffix, na - d.commonSuffix);
+
+    return true;
+}
+
+
+bool PayloadDiff::isEqual() const
+{
+    return firstMismatch < 0;
+}
+
+bool PayloadDiff::compute(const Payload &a, const Payload &b, PayloadDiff *diff, const QAtomicInt *cancel)
+{
+    *diff = PayloadDiff();
+    return diffBytes(reinterpret_cast<const uchar *>(a.constData()), a.size(),
+                     reinterpret_cast<const uchar *>(b.constData()), b.size(), *diff, cancel);
+}
+
+
+
+namespace {
+
+class DiffJob : public QRunnable
+{
+public:
+    DiffJob(DropDiffModel *model, const QSharedPointer<QAtomicInt> &cancel,
+            int generation, int row, const Payload &a, const Payload &b)
+        : mModel(model), mCancel(cancel), mGeneration(generation), mRow(row), mA(a), mB(b)
+    {
+    }
+
+    void run() override
+    {
+        QElapsedTimer timer;
+        timer.start();
+        PayloadDiff diff;
+        if( ! PayloadDiff::compute(mA, mB, &diff, mCancel.data()) || mCancel->load() )
+            return;
+
+        QMetaObject::invokeMethod(mModel, "deliver", Qt::QueuedConnection,
+                                  Q_ARG(int, mGeneration), Q_ARG(int, mRow), Q_ARG(PayloadDiff, diff),
+                                  Q_ARG(qint64, timer.nsecsElapsed()));
+    }
+
+private:
+    DropDiffModel *mModel;
+    QSharedPointer<QAtomicInt> mCancel;
+    int mGeneration;
+    int mRow;
+    Payload mA;
+    Payload mB;
+};
+
+}
+
+
+DropDiffModel::DropDiffModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , mPending(0)
+    , mCancel(new QAtomicInt(0))
+    , mGeneration(0)
+{
+    qRegisterMetaType<PayloadDiff>();
+}
+
+DropDiffModel::~DropDiffModel()
+{
+    mPool.clear();
+    mCancel->store(1);
+    mPool.waitForDone();
+    MemoryAccounting::instance().release(this);
+}
+
+int DropDiffModel::rowCount(const QModelIndex &parent) const
+{
+    if( parent.isValid() )
+        return 0;
+
+    return mRows.size();
+}
+
+int DropDiffModel::columnCount(const QModelIndex &) const
+{
+    return 9;
+}
+
+QVariant DropDiffModel::data(const QModelIndex &index, int role) const
+{
+    if( ! index.isValid() || index.row() >= mRows.size() )
+        return {};
+
+    const Row &r = mRows.at(index.row());
+    const bool diffed = r.status == Unchanged || r.status == Changed;
+    if( role == Qt::ToolTipRole ) {
+        if( r.status == Changed )
+            return segmentsToolTip(r.diff);
+        return {};
+    }
+    if( role != Qt::DisplayRole )
+        return {};
+
+    switch( index.column() ) {
+    case 0: return r.mime;
+    case 1: return statusString(r.status);
+    case 2: return r.sizeA < 0 ? QVariant() : QVariant(r.sizeA);
+    case 3: return r.sizeB < 0 ? QVariant() : QVariant(r.sizeB);
+    case 4:
+        if( r.sizeA < 0 || r.sizeB < 0 )
+            return {};
+        return r.sizeB >= r.sizeA ? QString("+%1").arg(r.sizeB - r.sizeA) : QString::number(r.sizeB - r.sizeA);
+    case 5: return diffed && r.diff.firstMismatch >= 0 ? QVariant(r.diff.firstMismatch) : QVariant();
+    case 6: return diffed ? QVariant(r.diff.matchedBytes) : QVariant();
+    case 7: return diffed ? QVariant(r.diff.literalBytes) : QVariant();
+    case 8: return r.nsecs < 0 ? QVariant() : QVariant(QString::number(double(r.nsecs) / 1e6, 'f', 3));
+    }
+
+    return {};
+}
+
+QVariant DropDiffModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+        return QVariant();
+
+    switch( section ) {
+    case 0:
+        return tr("MIME");
+    case 1:
+        return tr("Status");
+    case 2:
+        return tr("Size A");
+    case 3:
+        return tr("Size B");
+    case 4:
+        return tr("Delta");
+    case 5:
+        return tr("First mismatch");
+    case 6:
+        return tr("Matched");
+    case 7:
+        return tr("Literal");
+    case 8:
+        return tr("Time (ms)");
+    }
+
+    return {};
+}
+
+void DropDiffModel::compare(const DnDAction &a, const DnDAction &b)
+{
+    clear();
+    mTimer.start();
+
+    QVector<Row> rows;
+    QVector<QPair<Payload, Payload>> payloads;
+
+    // Duplicate MIME types are paired in order of appearance.
+    QHash<QString, QList<int>> inB;
+    for( int i = 0; i < b.data.size(); ++i )
+        inB[b.data.at(i).mime()].append(i);
+    QVector<bool> matchedB(b.data.size(), false);
+
+    auto addRow = [&](const DnDAction::DataEntry *ea, const DnDAction::DataEntry *eb) {
+        Row r;
+        r.mime = ea ? ea->mime() : eb->mime();
+        r.sizeA = -1;
+        r.sizeB = -1;
+        r.nsecs = -1;
+
+        Payload pa, pb;
+        if( ea && ea->isAvailable() ) {
+            pa = ea->payload();
+            r.sizeA = pa.size();
+        }
+        if( eb && eb->isAvailable() ) {
+            pb = eb->payload();
+            r.sizeB = pb.size();
+        }
+
+        if( ! eb )
+            r.status = Removed;
+        else if( ! ea )
+            r.status = Added;
+        else if( ! ea->isAvailable() || ! eb->isAvailable() )
+            r.status = Unavailable;
+        else if( pa.isSharedWith(pb) )
+            r.status = Unchanged;
+        else
+            r.status = Pending;
+
+        if( r.status == Unchanged ) {
+            r.diff.sizeA = r.diff.sizeB = r.diff.matchedBytes = pb.size();
+            if( pb.size() > 0 )
+                r.diff.segments.append({0, pb.size(), 0});
+        }
+
+        rows.append(r);
+        payloads.append(qMakePair(pa, pb));
+    };
+
+    for( const auto &ea : a.data ) {
+        QList<int> &candidates = inB[ea.mime()];
+        if( candidates.isEmpty() ) {
+            addRow(&ea, 0);
+        } else {
+            const int i = candidates.takeFirst();
+            matchedB[i] = true;
+            addRow(&ea, &b.data.at(i));
+        }
+    }
+    for( int i = 0; i < b.data.size(); ++i ) {
+        if( ! matchedB.at(i) )
+            addRow(0, &b.data.at(i));
+    }
+
+    beginResetModel();
+    mRows = rows;
+    endResetModel();
+
+    // Payloads are only held by the jobs comparing them.
+    QVector<MemoryAccounting::Holding> holdings;
+    for( int i = 0; i < mRows.size(); ++i ) {
+        if( mRows.at(i).status != Pending )
+            continue;
+
+        ++mPending;
+        mPool.start(new DiffJob(this, mCancel, mGeneration, i, payloads.at(i).first, payloads.at(i).second));
+        holdings.append(MemoryAccounting::Holding::of(payloads.at(i).first));
+        holdings.append(MemoryAccounting::Holding::of(payloads.at(i).second));
+    }
+    MemoryAccounting::instance().setHoldings(this, tr("Drop diff"), holdings);
+
+    if( mPending == 0 )
+        emit compared(mTimer.nsecsElapsed());
+}
+
+void DropDiffModel::clear()
+{
+    mPool.clear();
+    mCancel->store(1);
+    mCancel.reset(new QAtomicInt(0));
+    ++mGeneration;
+    mPending = 0;
+    MemoryAccounting::instance().release(this);
+
+    beginResetModel();
+    mRows.clear();
+    endResetModel();
+}
+
+bool DropDiffModel::isComparing() const
+{
+    return mPending > 0;
+}
+
+int DropDiffModel::count(Status status) const
+{
+    int n = 0;
+    for( const auto &r : mRows ) {
+        if( r.status == status )
+            ++n;
+    }
+    return n;
+}
+
+QJsonObject DropDiffModel::toJson() const
+{
+    QJsonArray formats;
+    for( const auto &r : mRows ) {
+        QJsonObject o;
+        o["mime"] = r.mime;
+        o["status"] = statusString(r.status);
+        o["sizeA"] = r.sizeA < 0 ? QJsonValue() : QJsonValue(double(r.sizeA));
+        o["sizeB"] = r.sizeB < 0 ? QJsonValue() : QJsonValue(double(r.sizeB));
+        if( r.status == Changed ) {
+            o["firstMismatch"] = double(r.diff.firstMismatch);
+            o["matchedBytes"] = double(r.diff.matchedBytes);
+            o["literalBytes"] = double(r.diff.literalBytes);
+            o["segments"] = r.diff.segments.size();
+        }
+        o["diffMs"] = r.nsecs < 0 ? QJsonValue() : QJsonValue(double(r.nsecs) / 1e6);
+        formats.append(o);
+    }
+
+    QJsonObject o;
+    o["added"] = count(Added);
+    o["removed"] = count(Removed);
+    o["changed"] = count(Changed);
+    o["unchanged"] = count(Unchanged);
+    o["formats"] = formats;
+    return o;
+}
+
+QString DropDiffModel::statusString(Status status)
+{
+    switch( status ) {
+    case Pending:
+        return tr("comparing...");
+    case Unchanged:
+        return tr("unchanged");
+    case Changed:
+        return tr("changed");
+    case Added:
+        return tr("added");
+    case Removed:
+        return tr("removed");
+    case Unavailable:
+        return tr("unavailable");
+    }
+
+    return {};
+}
+
+void DropDiffModel::deliver(int generation, int row, const PayloadDiff &diff, qint64 nsecs)
+{
+    if( generation != mGeneration || row >= mRows.size() )
+        return;
+
+    Row &r = mRows[row];
+    r.diff = diff;
+    r.nsecs = nsecs;
+    r.status = diff.isEqual() ? Unchanged : Changed;
+    emit dataChanged(index(row, 1), index(row, columnCount() - 1));
+
+    if( --mPending == 0 ) {
+        MemoryAccounting::instance().release(this);
+        emit compared(mTimer.nsecsElapsed());
+    }
+}
+
+QString DropDiffModel::segmentsToolTip(const PayloadDiff &diff) const
+{
+    static const int maxLines = 20;
+
+    QStringList lines;
+    for( const auto &s : diff.segments ) {
+        if( lines.size() == maxLines ) {
+            lines << tr("... %1 more segments").arg(diff.segments.size() - maxLines);
+            break;
+        }
+        if( s.source < 0 )
+            lines << tr("B %1 +%2: only in B").arg(s.offset).arg(s.length);
+        else
+            lines << tr("B %1 +%2: A %3").arg(s.offset).arg(s.length).arg(s.source);
+    }
+    return lines.join('\n');
+}
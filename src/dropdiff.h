@@ -0,0 +1,126 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef DROPDIFF_H
+#define DROPDIFF_H
+
+#include "dndaction.h"
+
+#include <QAbstractTableModel>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QThreadPool>
+#include <QVector>
+
+
+// Byte level difference of two payloads. The common prefix and suffix are
+// found with a vectorized scan, word-wise without SSE2; the rest of b is
+// matched against blocks of a with a rolling hash, rsync style. The segments
+// describe b in order, each either copied from a or literal.
+struct PayloadDiff
+{
+    struct Segment {
+        qint64 offset;
+        qint64 length;
+        // Offset of the same bytes in a, -1 for bytes only in b.
+        qint64 source;
+    };
+
+    qint64 sizeA = 0;
+    qint64 sizeB = 0;
+    // -1 if the payloads are equal.
+    qint64 firstMismatch = -1;
+    qint64 commonPrefix = 0;
+    qint64 commonSuffix = 0;
+    qint64 matchedBytes = 0;
+    qint64 literalBytes = 0;
+    qint64 blockSize = 0;
+    QVector<Segment> segments;
+
+    bool isEqual() const;
+
+    // Returns false if cancelled.
+    static bool compute(const Payload &a, const Payload &b, PayloadDiff *diff, const QAtomicInt *cancel = 0);
+};
+
+Q_DECLARE_METATYPE(PayloadDiff)
+
+
+// Formats of two captures aligned by MIME type, changed payloads are diffed
+// on a thread pool.
+class DropDiffModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Status {
+        Pending,
+        Unchanged,
+        Changed,
+        Added,
+        Removed,
+        Unavailable
+    };
+
+    explicit DropDiffModel(QObject *parent = 0);
+    ~DropDiffModel();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void compare(const DnDAction &a, const DnDAction &b);
+    void clear();
+
+    bool isComparing() const;
+    int count(Status status) const;
+    QJsonObject toJson() const;
+
+    static QString statusString(Status status);
+
+signals:
+    void compared(qint64 nsecs);
+
+private slots:
+    void deliver(int generation, int row, const PayloadDiff &diff, qint64 nsecs);
+
+private:
+    struct Row {
+        QString mime;
+        Status status;
+        qint64 sizeA;
+        qint64 sizeB;
+        PayloadDiff diff;
+        qint64 nsecs;
+    };
+
+    QString segmentsToolTip(const PayloadDiff &diff) const;
+
+    QVector<Row> mRows;
+    int mPending;
+    QElapsedTimer mTimer;
+
+    QThreadPool mPool;
+    QSharedPointer<QAtomicInt> mCancel;
+    int mGeneration;
+};
+
+#endif // DROPDIFF_H
@@ -0,0 +1,646 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "drophistory.h"
+
+#include "chunkedhash.h"
+#include "droparea.h"
+#include "memoryaccounting.h"
+
+#include <QDir>
+#include <QRunnable>
+#include <QTemporaryFile>
+
+#include <algorithm>
+#include <cstring>
+
+enum Column {
+    SequenceColumn,
+    TimeColumn,
+    ActionColumn,
+    FormatsColumn,
+    BytesColumn,
+    ColumnCount
+};
+
+struct DropHistory::Blob
+{
+    QByteArray key;
+    qint64 size = 0;
+    // Null once spilled.
+    Payload payload;
+    QSharedPointer<PayloadFile> spillFile;
+    qint64 spillOffset = -1;
+    int refs = 0;
+    qint64 lastUse = 0;
+
+    bool isSpilled() const { return spillOffset >= 0; }
+    bool isResident() const { return ! isSpilled() && ! payload.isMapped(); }
+
+    Payload data() const
+    {
+        return isSpilled() ? spillFile->map(spillOffset, size) : payload;
+    }
+};
+
+// Input and result of deduplicating the pending formats of one capture. The
+// worker only reads the snapshot, blobs are not touched off the GUI thread.
+struct DropHistory::InternBatch
+{
+    struct Candidate {
+        QSharedPointer<Blob> blob;
+        QByteArray key;
+        Payload data;
+    };
+
+    qint64 sequence = 0;
+    // Per format, null for formats that are not pending.
+    QVector<Payload> payloads;
+    // Blobs with the size of one of the payloads.
+    QVector<Candidate> candidates;
+
+    QVector<QByteArray> keys;
+    QVector<QSharedPointer<Blob>> matches;
+    // Earlier format of the same capture with equal data, or -1.
+    QVector<int> sameAs;
+};
+
+static const qint64 s_minCompactBytes = 64 * 1024 * 1024;
+
+static bool sameBytes(const Payload &a, const Payload &b)
+{
+    return a.size() == b.size()
+            && (a.size() == 0 || std::memcmp(a.constData(), b.constData(), size_t(a.size())) == 0);
+}
+
+class DropHistory::InternJob : public QRunnable
+{
+public:
+    InternJob(DropHistory *history, InternBatch *batch)
+        : mHistory(history), mBatch(batch)
+    {
+    }
+
+    void run() override
+    {
+        InternBatch &b = *mBatch;
+        const int count = b.payloads.size();
+        b.keys.resize(count);
+        b.matches.resize(count);
+        b.sameAs.fill(-1, count);
+
+        for( int i = 0; i < count; ++i ) {
+            const Payload &payload = b.payloads.at(i);
+            if( payload.isNull() )
+                continue;
+
+            b.keys[i] = payload.contentKey();
+            for( const auto &c : b.candidates ) {
+                // The key includes the size, a match is only a digest
+                // collision away from being equal.
+                if( c.key == b.keys.at(i) && sameBytes(c.data, payload) ) {
+                    b.matches[i] = c.blob;
+                    break;
+                }
+            }
+            for( int j = 0; ! b.matches.at(i) && j < i; ++j ) {
+                if( b.keys.at(j) == b.keys.at(i) && sameBytes(b.payloads.at(j), payload) ) {
+                    b.sameAs[i] = j;
+                    break;
+                }
+            }
+        }
+
+        QMetaObject::invokeMethod(mHistory, "finishIntern", Qt::QueuedConnection);
+    }
+
+private:
+    DropHistory *mHistory;
+    InternBatch *mBatch;
+};
+
+
+DropHistory::DropHistory(QObject *parent)
+    : QAbstractTableModel(parent)
+    , mFirst(0)
+    , mCount(0)
+    , mCapacity(256)
+    , mSequence(0)
+    , mMemoryBudget(256 * 1024 * 1024)
+    , mResidentBytes(0)
+    , mSpilledBytes(0)
+    , mSharedBytes(0)
+    , mSpillDeadBytes(0)
+{
+    mInternPool.setMaxThreadCount(1);
+}
+
+DropHistory::~DropHistory()
+{
+    mInternPool.waitForDone();
+    MemoryAccounting::instance().release(this);
+}
+
+int DropHistory::rowCount(const QModelIndex &parent) const
+{
+    if( parent.isValid() )
+        return 0;
+
+    return mCount;
+}
+
+int DropHistory::columnCount(const QModelIndex &) const
+{
+    return ColumnCount;
+}
+
+QVariant DropHistory::data(const QModelIndex &index, int role) const
+{
+    if( ! index.isValid() || role != Qt::DisplayRole )
+        return {};
+
+    const Capture &c = mCaptures.at(physicalIndex(index.row()));
+    switch( index.column() ) {
+    case SequenceColumn:
+        return c.sequence;
+    case TimeColumn:
+        return c.time.toString("hh:mm:ss.zzz");
+    case ActionColumn:
+        return DropDataModel::actionString(c.dropAction);
+    case FormatsColumn:
+        return c.formats.size();
+    case BytesColumn:
+        return c.bytes;
+    }
+
+    return {};
+}
+
+QVariant DropHistory::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+        return QVariant();
+
+    switch( section ) {
+    case SequenceColumn:
+        return tr("#");
+    case TimeColumn:
+        return tr("Time");
+    case ActionColumn:
+        return tr("Action");
+    case FormatsColumn:
+        return tr("Formats");
+    case BytesColumn:
+        return tr("Bytes");
+    }
+
+    return {};
+}
+
+int DropHistory::capacity() const
+{
+    return mCapacity;
+}
+
+void DropHistory::setCapacity(int captures)
+{
+    captures = qMax(1, captures);
+    if( captures == mCapacity )
+        return;
+
+    // Linearize oldest first so the ring can grow or shrink.
+    std::rotate(mCaptures.begin(), mCaptures.begin() + mFirst, mCaptures.end());
+    mFirst = 0;
+    mCapacity = captures;
+
+    const int excess = mCount - mCapacity;
+    if( excess > 0 ) {
+        beginRemoveRows(QModelIndex(), mCount - excess, mCount - 1);
+        for( int i = 0; i < excess; ++i )
+            release(mCaptures.at(i));
+        mCaptures.remove(0, excess);
+        mCount -= excess;
+        endRemoveRows();
+        account();
+        emit statsChanged();
+    }
+}
+
+qint64 DropHistory::memoryBudget() const
+{
+    return mMemoryBudget;
+}
+
+void DropHistory::setMemoryBudget(qint64 bytes)
+{
+    mMemoryBudget = qMax<qint64>(0, bytes);
+    evict();
+    account();
+    emit statsChanged();
+}
+
+int DropHistory::dropAction(int row) const
+{
+    return mCaptures.at(physicalIndex(row)).dropAction;
+}
+
+DnDAction DropHistory::capture(int row) const
+{
+    const Capture &c = mCaptures.at(physicalIndex(row));
+
+    DnDAction act;
+    act.supportedActions = c.supportedActions;
+    act.defaultAction = c.defaultAction;
+    for( const auto &f : c.formats ) {
+        if( f.blob && f.blob->isSpilled() ) {
+            QSharedPointer<PayloadSource> source(new FileRegionSource(f.blob->spillFile, f.blob->spillOffset,
+                                                                      f.blob->size));
+            act.data.append(DnDAction::DataEntry(f.mime, source));
+        } else if( f.blob ) {
+            act.data.append(DnDAction::DataEntry(f.mime, f.blob->payload));
+        } else if( ! f.pending.isNull() ) {
+            act.data.append(DnDAction::DataEntry(f.mime, f.pending));
+        } else if( f.source ) {
+            act.data.append(DnDAction::DataEntry(f.mime, f.source));
+        } else {
+            act.data.append(DnDAction::DataEntry(f.mime, Payload()));
+        }
+    }
+
+    return act;
+}
+
+qint64 DropHistory::residentBytes() const
+{
+    return mResidentBytes;
+}
+
+qint64 DropHistory::spilledBytes() const
+{
+    return mSpilledBytes;
+}
+
+qint64 DropHistory::sharedBytes() const
+{
+    return mSharedBytes;
+}
+
+void DropHistory::record(int dropAction, const DnDAction &data)
+{
+    Capture c;
+    c.sequence = ++mSequence;
+    c.time = QDateTime::currentDateTime();
+    c.dropAction = dropAction;
+    c.supportedActions = data.supportedActions;
+    c.defaultAction = data.defaultAction;
+    c.bytes = 0;
+
+    bool pending = false;
+    for( const auto &e : data.data ) {
+        Format f;
+        f.mime = e.mime();
+        if( e.isFetched() ) {
+            f.pending = e.payload();
+            c.bytes += f.pending.size();
+            pending = pending || ! f.pending.isNull();
+        } else {
+            // Do not share the lazy cache of the entry, it would pin whatever
+            // gets fetched later.
+            f.source = e.source();
+        }
+        c.formats.append(f);
+    }
+
+    if( mCaptures.size() < mCapacity ) {
+        beginInsertRows(QModelIndex(), 0, 0);
+        mCaptures.append(c);
+        ++mCount;
+        endInsertRows();
+    } else {
+        // Overwrite the oldest capture in place.
+        beginRemoveRows(QModelIndex(), mCount - 1, mCount - 1);
+        release(mCaptures.at(mFirst));
+        --mCount;
+        endRemoveRows();
+
+        beginInsertRows(QModelIndex(), 0, 0);
+        mCaptures[mFirst] = c;
+        mFirst = (mFirst + 1) % mCaptures.size();
+        ++mCount;
+        endInsertRows();
+    }
+
+    if( pending ) {
+        mInternQueue.append(c.sequence);
+        startIntern();
+    }
+
+    evict();
+    account();
+    emit statsChanged();
+}
+
+void DropHistory::clear()
+{
+    beginResetModel();
+    mCaptures.clear();
+    mFirst = 0;
+    mCount = 0;
+    mBlobs.clear();
+    mResidentBytes = 0;
+    mSpilledBytes = 0;
+    mSharedBytes = 0;
+    // A running batch finds none of its captures and is dropped.
+    mInternQueue.clear();
+    mSpillReader.clear();
+    mSpillFile.reset();
+    mSpillDeadBytes = 0;
+    endResetModel();
+
+    account();
+    emit statsChanged();
+}
+
+// Spilled blobs are only mapped while a capture is looked at, they are not
+// held here.
+void DropHistory::account()
+{
+    QVector<MemoryAccounting::Holding> holdings;
+    for( const auto &blob : mBlobs ) {
+        if( ! blob->isSpilled() )
+            holdings.append(MemoryAccounting::Holding::of(blob->payload));
+    }
+    for( const auto &c : mCaptures ) {
+        for( const auto &f : c.formats ) {
+            if( ! f.pending.isNull() )
+                holdings.append(MemoryAccounting::Holding::of(f.pending));
+        }
+    }
+    MemoryAccounting::instance().setHoldings(this, tr("Drop history"), holdings);
+}
+
+int DropHistory::physicalIndex(int row) const
+{
+    // Row 0 is the newest capture, it sits right before the oldest one.
+    const int size = mCaptures.size();
+    return (mFirst + size - 1 - row) % size;
+}
+
+DropHistory::Capture *DropHistory::findCapture(qint64 sequence)
+{
+    for( auto &c : mCaptures ) {
+        if( c.sequence == sequence )
+            return &c;
+    }
+
+    return nullptr;
+}
+
+void DropHistory::startIntern()
+{
+    if( mInternBatch )
+        return;
+
+    while( ! mInternQueue.isEmpty() ) {
+        const Capture *c = findCapture(mInternQueue.takeFirst());
+        if( ! c )
+            continue;
+
+        QScopedPointer<InternBatch> batch(new InternBatch);
+        batch->sequence = c->sequence;
+        QVector<qint64> sizes;
+        for( const auto &f : c->formats ) {
+            batch->payloads.append(f.pending);
+            if( ! f.pending.isNull() )
+                sizes.append(f.pending.size());
+        }
+        for( const auto &blob : mBlobs ) {
+            if( ! sizes.contains(blob->size) )
+                continue;
+            InternBatch::Candidate candidate;
+            candidate.blob = blob;
+            candidate.key = blob->key;
+            candidate.data = blob->data();
+            batch->candidates.append(candidate);
+        }
+
+        mInternBatch.swap(batch);
+        mInternPool.start(new InternJob(this, mInternBatch.data()));
+        return;
+    }
+}
+
+void DropHistory::finishIntern()
+{
+    QScopedPointer<InternBatch> batch(mInternBatch.take());
+
+    Capture *c = findCapture(batch->sequence);
+    if( c ) {
+        for( int i = 0; i < c->formats.size(); ++i ) {
+            Format &f = c->formats[i];
+            if( f.pending.isNull() )
+                continue;
+
+            // Candidates may have been released while the batch was running.
+            QSharedPointer<Blob> blob = batch->matches.at(i);
+            if( ! blob && batch->sameAs.at(i) >= 0 )
+                blob = c->formats.at(batch->sameAs.at(i)).blob;
+
+            if( blob && blob->refs > 0 ) {
+                ++blob->refs;
+                blob->lastUse = mSequence;
+                mSharedBytes += blob->size;
+            } else {
+                blob = addBlob(batch->keys.at(i), f.pending);
+            }
+            f.blob = blob;
+            f.pending = Payload();
+        }
+
+        evict();
+        account();
+        emit statsChanged();
+    }
+
+    startIntern();
+}
+
+QSharedPointer<DropHistory::Blob> DropHistory::addBlob(const QByteArray &key, const Payload &payload)
+{
+    QSharedPointer<Blob> blob(new Blob);
+    blob->key = key;
+    blob->size = payload.size();
+    blob->payload = payload;
+    blob->refs = 1;
+    blob->lastUse = mSequence;
+    // Payloads that are already backed by a file do not cost heap memory.
+    if( blob->isResident() )
+        mResidentBytes += blob->size;
+    else
+        mSpilledBytes += blob->size;
+    mBlobs.insert(key, blob);
+
+    return blob;
+}
+
+void DropHistory::release(const Capture &capture)
+{
+    for( const auto &f : capture.formats ) {
+        if( ! f.blob )
+            continue;
+
+        Blob &blob = *f.blob;
+        if( --blob.refs > 0 ) {
+            mSharedBytes -= blob.size;
+            continue;
+        }
+
+        if( blob.isResident() )
+            mResidentBytes -= blob.size;
+        else
+            mSpilledBytes -= blob.size;
+        if( blob.isSpilled() )
+            mSpillDeadBytes += blob.size;
+        mBlobs.remove(blob.key, f.blob);
+    }
+
+    if( ! mSpillFile )
+        return;
+
+    if( mBlobs.isEmpty() ) {
+        mSpillReader.clear();
+        mSpillFile.reset();
+        mSpillDeadBytes = 0;
+    } else if( mSpillDeadBytes > qMax(s_minCompactBytes, mSpillFile->size() - mSpillDeadBytes) ) {
+        compactSpillFile();
+    }
+}
+
+void DropHistory::evict()
+{
+    if( mResidentBytes <= mMemoryBudget )
+        return;
+
+    QVector<QSharedPointer<Blob>> resident;
+    for( const auto &blob : mBlobs ) {
+        if( blob->isResident() )
+            resident.append(blob);
+    }
+    std::sort(resident.begin(), resident.end(), [](const QSharedPointer<Blob> &a, const QSharedPointer<Blob> &b) {
+        return a->lastUse < b->lastUse;
+    });
+
+    for( const auto &blob : resident ) {
+        if( mResidentBytes <= mMemoryBudget || ! spill(*blob) )
+            break;
+    }
+}
+
+static bool openSpillFile(QScopedPointer<QTemporaryFile> &file, QSharedPointer<PayloadFile> &reader)
+{
+    file.reset(new QTemporaryFile(QDir::tempPath() + "/DragonDropTest-history-XXXXXX"));
+    if( ! file->open() ) {
+        qWarning("Cannot create history spill file: %s", qPrintable(file->errorString()));
+        file.reset();
+        return false;
+    }
+
+    reader = PayloadFile::open(file->fileName());
+    if( ! reader ) {
+        file.reset();
+        return false;
+    }
+
+    return true;
+}
+
+// Appends at the end of the file, returns the offset or -1.
+static qint64 appendSpill(QFile &file, const char *data, qint64 size)
+{
+    const qint64 offset = file.size();
+    if( ! file.seek(offset) )
+        return -1;
+
+    for( qint64 pos = 0; pos < size; ) {
+        const qint64 written = file.write(data + pos, qMin(ChunkedHash::ChunkSize, size - pos));
+        if( written <= 0 ) {
+            qWarning("Cannot write history spill file: %s", qPrintable(file.errorString()));
+            file.resize(offset);
+            return -1;
+        }
+        pos += written;
+    }
+
+    return file.flush() ? offset : -1;
+}
+
+bool DropHistory::spill(Blob &blob)
+{
+    if( ! mSpillFile && ! openSpillFile(mSpillFile, mSpillReader) )
+        return false;
+
+    const qint64 offset = appendSpill(*mSpillFile, blob.payload.constData(), blob.size);
+    if( offset < 0 )
+        return false;
+
+    blob.spillFile = mSpillReader;
+    blob.spillOffset = offset;
+    blob.payload = Payload();
+    mResidentBytes -= blob.size;
+    mSpilledBytes += blob.size;
+
+    return true;
+}
+
+// Copies the live regions to a new spill file. Payloads and sources handed
+// out for the old file keep it open, it is only removed from the directory.
+void DropHistory::compactSpillFile()
+{
+    QVector<QSharedPointer<Blob>> live;
+    for( const auto &blob : mBlobs ) {
+        if( blob->isSpilled() )
+            live.append(blob);
+    }
+    std::sort(live.begin(), live.end(), [](const QSharedPointer<Blob> &a, const QSharedPointer<Blob> &b) {
+        return a->spillOffset < b->spillOffset;
+    });
+
+    QScopedPointer<QTemporaryFile> file;
+    QSharedPointer<PayloadFile> reader;
+    if( ! openSpillFile(file, reader) )
+        return;
+
+    QVector<qint64> offsets;
+    for( const auto &blob : live ) {
+        const Payload data = blob->data();
+        const qint64 offset = data.isNull() ? -1 : appendSpill(*file, data.constData(), blob->size);
+        if( offset < 0 ) {
+            qWarning("Cannot compact history spill file, keeping %lld dead bytes", mSpillDeadBytes);
+            return;
+        }
+        offsets.append(offset);
+    }
+
+    for( int i = 0; i < live.size(); ++i ) {
+        live.at(i)->spillFile = reader;
+        live.at(i)->spillOffset = offsets.at(i);
+    }
+    mSpillFile.swap(file);
+    mSpillReader = reader;
+    mSpillDeadBytes = 0;
+}
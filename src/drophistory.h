@@ -0,0 +1,135 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DROPHISTORY_H
+#define DROPHISTORY_H
+
+#include "dndaction.h"
+
+#include <QAbstractTableModel>
+#include <QDateTime>
+#include <QHash>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QThreadPool>
+
+class QTemporaryFile;
+
+
+// Ring buffer of past drop captures. Payloads are deduplicated by content
+// across captures; hashing and comparing runs on a worker thread after the
+// capture was recorded, one capture at a time. Once the heap payloads exceed
+// the memory budget, those of the oldest captures are appended to a spill
+// file and mapped back on demand. The spill file is compacted when more than
+// half of it is dead.
+//
+// Formats that were not fetched when recorded keep only their source, and
+// formats still waiting to be deduplicated are not accounted for.
+class DropHistory : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit DropHistory(QObject *parent = 0);
+    ~DropHistory();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    int capacity() const;
+    void setCapacity(int captures);
+    qint64 memoryBudget() const;
+    void setMemoryBudget(qint64 bytes);
+
+    int dropAction(int row) const;
+    DnDAction capture(int row) const;
+
+    // Unique payload bytes held on the heap, resp. in the spill file.
+    qint64 residentBytes() const;
+    qint64 spilledBytes() const;
+    // Bytes saved by deduplication.
+    qint64 sharedBytes() const;
+
+signals:
+    void statsChanged();
+
+public slots:
+    void record(int dropAction, const DnDAction &data);
+    void clear();
+
+private slots:
+    void finishIntern();
+
+private:
+    struct Blob;
+    struct InternBatch;
+    class InternJob;
+    struct Format {
+        QString mime;
+        QSharedPointer<Blob> blob;
+        // Fetched, but not deduplicated yet.
+        Payload pending;
+        QSharedPointer<PayloadSource> source;
+    };
+    struct Capture {
+        qint64 sequence;
+        QDateTime time;
+        int dropAction;
+        Qt::DropActions supportedActions;
+        Qt::DropAction defaultAction;
+        QVector<Format> formats;
+        qint64 bytes;
+    };
+
+    int physicalIndex(int row) const;
+    Capture *findCapture(qint64 sequence);
+    void startIntern();
+    QSharedPointer<Blob> addBlob(const QByteArray &key, const Payload &payload);
+    void release(const Capture &capture);
+    void evict();
+    bool spill(Blob &blob);
+    void compactSpillFile();
+    void account();
+
+    QVector<Capture> mCaptures;
+    // Index of the oldest capture once the ring is full, 0 before.
+    int mFirst;
+    int mCount;
+    int mCapacity;
+    qint64 mSequence;
+
+    QMultiHash<QByteArray, QSharedPointer<Blob>> mBlobs;
+    qint64 mMemoryBudget;
+    qint64 mResidentBytes;
+    qint64 mSpilledBytes;
+    qint64 mSharedBytes;
+
+    // Sequences of captures waiting to be deduplicated.
+    QVector<qint64> mInternQueue;
+    QScopedPointer<InternBatch> mInternBatch;
+    QThreadPool mInternPool;
+
+    QScopedPointer<QTemporaryFile> mSpillFile;
+    QSharedPointer<PayloadFile> mSpillReader;
+    // Bytes of the spill file no blob refers to anymore.
+    qint64 mSpillDeadBytes;
+};
+
+#endif // DROPHISTORY_H
@@ -0,0 +1,52 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dropsimulator.h"
+
+#include <QApplication>
+#include <QDragEnterEvent>
+#include <QWidget>
+
+
+Qt::DropAction DropSimulator::drop(QWidget *target, const QMimeData *mimeData,
+                                   Qt::DropActions supportedActions,
+                                   Qt::KeyboardModifiers modifiers)
+{
+    const QPoint pos = target->rect().center();
+
+    QDragEnterEvent enter(pos, supportedActions, mimeData, Qt::LeftButton, modifiers);
+    QApplication::sendEvent(target, &enter);
+    if( ! enter.isAccepted() ) {
+        QDragLeaveEvent leave;
+        QApplication::sendEvent(target, &leave);
+        return Qt::IgnoreAction;
+    }
+
+    QDragMoveEvent move(pos, supportedActions, mimeData, Qt::LeftButton, modifiers);
+    QApplication::sendEvent(target, &move);
+    if( ! move.isAccepted() ) {
+        QDragLeaveEvent leave;
+        QApplication::sendEvent(target, &leave);
+        return Qt::IgnoreAction;
+    }
+
+    QDropEvent drop(pos, supportedActions, mimeData, Qt::LeftButton, modifiers);
+    QApplication::sendEvent(target, &drop);
+
+    return drop.isAccepted() ? drop.dropAction() : Qt::IgnoreAction;
+}
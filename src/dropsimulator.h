@@ -0,0 +1,39 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DROPSIMULATOR_H
+#define DROPSIMULATOR_H
+
+#include <Qt>
+
+class QMimeData;
+class QWidget;
+
+
+// Delivers the drag enter, drag move and drop events a platform drag would
+// produce over the center of target, without a real drag. Returns the
+// accepted drop action.
+namespace DropSimulator {
+
+Qt::DropAction drop(QWidget *target, const QMimeData *mimeData,
+                    Qt::DropActions supportedActions,
+                    Qt::KeyboardModifiers modifiers = Qt::NoModifier);
+
+}
+
+#endif // DROPSIMULATOR_H
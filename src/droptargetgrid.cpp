@@ -0,0 +1,452 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "droptargetgrid.h"
+
+#include "droparea.h"
+#include "memoryaccounting.h"
+
+#include <QCheckBox>
+#include <QComboBox>
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QItemSelectionModel>
+#include <QLabel>
+#include <QSpinBox>
+#include <QSplitter>
+#include <QTableView>
+#include <QTreeView>
+#include <QVBoxLayout>
+
+#include <cmath>
+
+static const int s_defaultTargetCount = 4;
+static const int s_maxTargetCount = 16;
+
+namespace {
+
+struct Policy {
+    const char *name;
+    Qt::DropActions actions;
+};
+
+const Policy s_policies[] = {
+    { QT_TRANSLATE_NOOP("DropTargetGrid", "Any action"), Qt::CopyAction | Qt::MoveAction | Qt::LinkAction },
+    { QT_TRANSLATE_NOOP("DropTargetGrid", "Copy only"), Qt::CopyAction },
+    { QT_TRANSLATE_NOOP("DropTargetGrid", "Move only"), Qt::MoveAction },
+    { QT_TRANSLATE_NOOP("DropTargetGrid", "Link only"), Qt::LinkAction },
+};
+
+}
+
+static QVariant nsecsToVariant(qint64 nsecs)
+{
+    return nsecs < 0 ? QVariant() : QVariant(QString::number(double(nsecs) / 1e6, 'f', 3));
+}
+
+
+DropGridSummaryModel::DropGridSummaryModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+    // Captures share their lazy entries with the target models.
+    MemoryAccounting::instance().setProvider(this, tr("Drop target grid"), [this]() {
+        QVector<MemoryAccounting::Holding> holdings;
+        for( const auto &t : mTargets ) {
+            for( const auto &e : t.data.data ) {
+                if( e.isFetched() )
+                    holdings.append(MemoryAccounting::Holding::of(e.payload()));
+            }
+        }
+        return holdings;
+    });
+}
+
+DropGridSummaryModel::~DropGridSummaryModel()
+{
+    MemoryAccounting::instance().release(this);
+}
+
+int DropGridSummaryModel::rowCount(const QModelIndex &parent) const
+{
+    if( parent.isValid() )
+        return 0;
+
+    return mTargets.size();
+}
+
+int DropGridSummaryModel::columnCount(const QModelIndex &) const
+{
+    return 9;
+}
+
+QVariant DropGridSummaryModel::data(const QModelIndex &index, int role) const
+{
+    if( ! index.isValid() || role != Qt::DisplayRole )
+        return {};
+
+    const auto &t = mTargets.at(index.row());
+    if( index.column() == 0 )
+        return index.row() + 1;
+    if( index.column() == 1 )
+        return t.policy;
+    if( t.captures == 0 )
+        return {};
+
+    switch( index.column() ) {
+    case 2: return DropDataModel::actionString(t.dropAction);
+    case 3: return t.data.data.size();
+    case 4: return fetchedBytes(t.timings);
+    case 5: return nsecsToVariant(t.timings.enterToDropNsecs);
+    case 6: return nsecsToVariant(fetchedNsecs(t.timings));
+    case 7: return nsecsToVariant(t.timings.modelResetNsecs);
+    case 8: return compare(index.row());
+    }
+
+    return {};
+}
+
+QVariant DropGridSummaryModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+        return QVariant();
+
+    switch( section ) {
+    case 0:
+        return tr("Target");
+    case 1:
+        return tr("Policy");
+    case 2:
+        return tr("Action");
+    case 3:
+        return tr("Formats");
+    case 4:
+        return tr("Fetched bytes");
+    case 5:
+        return tr("Enter to drop (ms)");
+    case 6:
+        return tr("Fetch (ms)");
+    case 7:
+        return tr("Model (ms)");
+    case 8:
+        return tr("Content");
+    }
+
+    return {};
+}
+
+void DropGridSummaryModel::setTargetCount(int count)
+{
+    if( count == mTargets.size() )
+        return;
+
+    if( count < mTargets.size() ) {
+        beginRemoveRows({}, count, mTargets.size() - 1);
+        mTargets.resize(count);
+        endRemoveRows();
+        MemoryAccounting::instance().refresh(this);
+        // The reference may have been removed.
+        if( ! mTargets.isEmpty() )
+            emit dataChanged(index(0, 8), index(mTargets.size() - 1, 8));
+    } else {
+        beginInsertRows({}, mTargets.size(), count - 1);
+        mTargets.resize(count);
+        endInsertRows();
+    }
+}
+
+void DropGridSummaryModel::setPolicy(int target, const QString &policy)
+{
+    mTargets[target].policy = policy;
+    emit dataChanged(index(target, 1), index(target, 1));
+}
+
+void DropGridSummaryModel::setCapture(int target, int dropAction, const DnDAction &data, const DropTimings &timings)
+{
+    auto &t = mTargets[target];
+    ++t.captures;
+    t.dropAction = dropAction;
+    t.data = data;
+    t.timings = timings;
+    MemoryAccounting::instance().refresh(this);
+
+    // A new capture can change the reference of all other targets.
+    emit dataChanged(index(0, 2), index(mTargets.size() - 1, columnCount() - 1));
+}
+
+void DropGridSummaryModel::setModelReset(int target, qint64 nsecs)
+{
+    mTargets[target].timings.modelResetNsecs = nsecs;
+    emit dataChanged(index(target, 7), index(target, 7));
+}
+
+void DropGridSummaryModel::setFetched(int target, int format, qint64 nsecs, qint64 bytes)
+{
+    auto &formats = mTargets[target].timings.formats;
+    if( format < 0 || format >= formats.size() )
+        return;
+
+    formats[format].fetchNsecs = nsecs;
+    formats[format].bytes = bytes;
+    emit dataChanged(index(target, 4), index(target, 6));
+    emit dataChanged(index(0, 8), index(mTargets.size() - 1, 8));
+}
+
+int DropGridSummaryModel::reference() const
+{
+    for( int i = 0; i < mTargets.size(); ++i ) {
+        if( mTargets.at(i).captures > 0 )
+            return i;
+    }
+    return -1;
+}
+
+QString DropGridSummaryModel::compare(int target) const
+{
+    const int ref = reference();
+    if( target == ref )
+        return tr("reference");
+
+    const auto &a = mTargets.at(ref).data.data;
+    const auto &b = mTargets.at(target).data.data;
+    if( a.size() != b.size() )
+        return tr("different formats");
+    for( int i = 0; i < a.size(); ++i ) {
+        if( a.at(i).mime() != b.at(i).mime() )
+            return tr("different formats");
+    }
+
+    int differ = 0;
+    int unknown = 0;
+    for( int i = 0; i < a.size(); ++i ) {
+        if( ! a.at(i).isFetched() || ! b.at(i).isFetched() ) {
+            ++unknown;
+            continue;
+        }
+        const Payload pa = a.at(i).payload();
+        const Payload pb = b.at(i).payload();
+        if( ! pa.isSharedWith(pb) && pa.contentKey() != pb.contentKey() )
+            ++differ;
+    }
+
+    if( differ > 0 )
+        return tr("%n format(s) differ", "", differ);
+    if( unknown > 0 )
+        return tr("same, %n not fetched", "", unknown);
+    return tr("same");
+}
+
+qint64 DropGridSummaryModel::fetchedNsecs(const DropTimings &timings)
+{
+    qint64 nsecs = -1;
+    for( const auto &f : timings.formats ) {
+        if( f.fetchNsecs >= 0 )
+            nsecs = qMax<qint64>(nsecs, 0) + f.fetchNsecs;
+    }
+    return nsecs;
+}
+
+qint64 DropGridSummaryModel::fetchedBytes(const DropTimings &timings)
+{
+    qint64 bytes = 0;
+    for( const auto &f : timings.formats ) {
+        if( f.bytes > 0 )
+            bytes += f.bytes;
+    }
+    return bytes;
+}
+
+
+
+DropTargetGrid::DropTargetGrid(QWidget *parent)
+    : QWidget(parent)
+    , mNextInternId(0)
+    , mCountSpin(new QSpinBox)
+    , mGrid(new QGridLayout)
+{
+    connect(&mInterner, &PayloadInterner::interned, this, &DropTargetGrid::showCapture);
+
+    setWindowTitle(tr("Drop targets"));
+
+    mCountSpin->setRange(1, s_maxTargetCount);
+    mCountSpin->setSuffix(tr(" targets"));
+
+    auto *top = new QHBoxLayout;
+    top->addWidget(mCountSpin);
+    top->addStretch(1);
+
+    auto *gridWidget = new QWidget;
+    gridWidget->setLayout(mGrid);
+
+    auto *summary = new QTableView;
+    summary->setModel(&mSummary);
+    summary->verticalHeader()->hide();
+    summary->horizontalHeader()->setStretchLastSection(true);
+
+    auto *splitter = new QSplitter(Qt::Vertical);
+    splitter->addWidget(gridWidget);
+    splitter->addWidget(summary);
+    splitter->setStretchFactor(0, 3);
+    splitter->setStretchFactor(1, 1);
+
+    auto *layout = new QVBoxLayout(this);
+    layout->addLayout(top);
+    layout->addWidget(splitter, 1);
+
+    setTargetCount(s_defaultTargetCount);
+    mCountSpin->setValue(s_defaultTargetCount);
+    connect(mCountSpin, SIGNAL(valueChanged(int)), this, SLOT(setTargetCount(int)));
+}
+
+DropTargetGrid::~DropTargetGrid()
+{
+    // The cells own the models the summary view may still refer to.
+    setTargetCount(0);
+}
+
+int DropTargetGrid::targetCount() const
+{
+    return mTargets.size();
+}
+
+void DropTargetGrid::setTargetCount(int count)
+{
+    count = qBound(0, count, s_maxTargetCount);
+    if( count == mTargets.size() )
+        return;
+
+    while( mTargets.size() > count ) {
+        const int id = mInternIds.last();
+        if( id >= 0 ) {
+            mInterner.cancel(id);
+            mCaptures.remove(id);
+        }
+        mInternIds.removeLast();
+        delete mTargets.last().cell;
+        mTargets.removeLast();
+    }
+    mMeasured.resize(count);
+    mInternIds.resize(count);
+    mSummary.setTargetCount(count);
+    while( mTargets.size() < count ) {
+        mInternIds[mTargets.size()] = -1;
+        mTargets.append(createTarget(mTargets.size()));
+        updatePolicy(mTargets.size() - 1);
+    }
+
+    relayout();
+}
+
+void DropTargetGrid::updatePolicy(int target)
+{
+    const auto &t = mTargets.at(target);
+    const Policy &policy = s_policies[t.policy->currentIndex()];
+    t.area->setAcceptedActions(policy.actions);
+    t.area->setLazyFetch(t.lazy->isChecked());
+
+    QString text = tr(policy.name);
+    if( t.lazy->isChecked() )
+        text = tr("%1, lazy").arg(text);
+    mSummary.setPolicy(target, text);
+}
+
+DropTargetGrid::Target DropTargetGrid::createTarget(int target)
+{
+    Target t;
+    t.cell = new QWidget;
+    t.policy = new QComboBox;
+    for( const auto &p : s_policies )
+        t.policy->addItem(tr(p.name));
+    t.lazy = new QCheckBox(tr("Lazy"));
+    t.lazy->setToolTip(tr("Only fetch data of a format when it is selected"));
+    t.area = new DropArea;
+    t.area->setDropActionString(tr("target %1").arg(target + 1));
+    t.area->setAlignment(Qt::AlignCenter);
+    t.area->setMinimumHeight(60);
+    t.model = new DropDataModel(t.cell);
+    t.view = new QTreeView;
+    t.view->setModel(t.model);
+    t.view->setRootIsDecorated(false);
+    t.view->setUniformRowHeights(true);
+
+    auto *controls = new QHBoxLayout;
+    controls->addWidget(new QLabel(tr("#%1").arg(target + 1)));
+    controls->addWidget(t.policy, 1);
+    controls->addWidget(t.lazy);
+
+    auto *layout = new QVBoxLayout(t.cell);
+    layout->setContentsMargins(0, 0, 0, 0);
+    layout->addLayout(controls);
+    layout->addWidget(t.area);
+    layout->addWidget(t.view, 1);
+
+    connect(t.policy, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged),
+            this, [this, target]() { updatePolicy(target); });
+    connect(t.lazy, &QCheckBox::toggled, this, [this, target]() { updatePolicy(target); });
+
+    // DropArea reports the timings of a drop right before its data.
+    connect(t.area, &DropArea::dropMeasured, this, [this, target](const DropTimings &timings) {
+        mMeasured[target] = timings;
+    });
+    connect(t.area, &DropArea::dataDropped, this, [this, target](int dropAction, const DnDAction &data) {
+        if( mInternIds.at(target) >= 0 ) {
+            mInterner.cancel(mInternIds.at(target));
+            mCaptures.remove(mInternIds.at(target));
+        }
+
+        Capture capture;
+        capture.target = target;
+        capture.dropAction = dropAction;
+        capture.timings = mMeasured.at(target);
+        mInternIds[target] = mNextInternId++;
+        mCaptures.insert(mInternIds.at(target), capture);
+        mInterner.intern(mInternIds.at(target), data);
+    });
+    DropDataModel *model = t.model;
+    connect(t.model, &DropDataModel::rowFetched, this, [this, target](int row, qint64 nsecs, qint64 bytes) {
+        mSummary.setFetched(target, row, nsecs, bytes);
+    });
+    connect(t.view->selectionModel(), &QItemSelectionModel::currentChanged, model, [model](const QModelIndex &current) {
+        if( current.isValid() )
+            model->fetch(current.row());
+    });
+
+    return t;
+}
+
+void DropTargetGrid::showCapture(int id, const DnDAction &data)
+{
+    const Capture capture = mCaptures.take(id);
+    if( capture.target < 0 )
+        return;
+
+    mInternIds[capture.target] = -1;
+    DropDataModel *model = mTargets.at(capture.target).model;
+    model->setDropData(capture.dropAction, data);
+    mSummary.setCapture(capture.target, capture.dropAction, data, capture.timings);
+    mSummary.setModelReset(capture.target, model->lastResetNsecs());
+}
+
+void DropTargetGrid::relayout()
+{
+    for( const auto &t : mTargets )
+        mGrid->removeWidget(t.cell);
+
+    const int columns = qMax(1, int(std::ceil(std::sqrt(double(mTargets.size())))));
+    for( int i = 0; i < mTargets.size(); ++i )
+        mGrid->addWidget(mTargets.at(i).cell, i / columns, i % columns);
+}
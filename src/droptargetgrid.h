@@ -0,0 +1,132 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DROPTARGETGRID_H
+#define DROPTARGETGRID_H
+
+#include "dndaction.h"
+#include "droptimings.h"
+#include "payloadinterner.h"
+
+#include <QAbstractTableModel>
+#include <QVector>
+#include <QWidget>
+
+class DropArea;
+class DropDataModel;
+class QCheckBox;
+class QComboBox;
+class QGridLayout;
+class QSpinBox;
+class QTreeView;
+
+
+// Latest capture of every target of a DropTargetGrid, compared against the
+// first target that captured something. Payloads are only compared where
+// both sides are fetched.
+class DropGridSummaryModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit DropGridSummaryModel(QObject *parent = 0);
+    ~DropGridSummaryModel();
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    void setTargetCount(int count);
+    void setPolicy(int target, const QString &policy);
+    void setCapture(int target, int dropAction, const DnDAction &data, const DropTimings &timings);
+    void setModelReset(int target, qint64 nsecs);
+    void setFetched(int target, int format, qint64 nsecs, qint64 bytes);
+
+private:
+    struct Target {
+        QString policy;
+        int captures = 0;
+        int dropAction = -2;
+        DnDAction data;
+        DropTimings timings;
+    };
+
+    int reference() const;
+    QString compare(int target) const;
+    static qint64 fetchedNsecs(const DropTimings &timings);
+    static qint64 fetchedBytes(const DropTimings &timings);
+
+    QVector<Target> mTargets;
+};
+
+
+// Grid of independent drop targets, each with its own accept policy, fetch
+// mode and model, to compare how a source behaves towards different targets.
+// Captures are interned before they are shown, so targets that read the same
+// data share one copy of it.
+class DropTargetGrid : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit DropTargetGrid(QWidget *parent = 0);
+    ~DropTargetGrid();
+
+    int targetCount() const;
+
+public slots:
+    void setTargetCount(int count);
+
+private slots:
+    void updatePolicy(int target);
+    void showCapture(int id, const DnDAction &data);
+
+private:
+    struct Target {
+        QWidget *cell = nullptr;
+        QComboBox *policy = nullptr;
+        QCheckBox *lazy = nullptr;
+        DropArea *area = nullptr;
+        DropDataModel *model = nullptr;
+        QTreeView *view = nullptr;
+    };
+
+    // Drop waiting for its data to be interned.
+    struct Capture {
+        int target = -1;
+        int dropAction = -2;
+        DropTimings timings;
+    };
+
+    Target createTarget(int target);
+    void relayout();
+
+    QVector<Target> mTargets;
+    // Timings of the drop whose data is reported next, per target.
+    QVector<DropTimings> mMeasured;
+    // Pending interner request of each target, -1 if none.
+    QVector<int> mInternIds;
+    QHash<int, Capture> mCaptures;
+    int mNextInternId;
+    PayloadInterner mInterner;
+    QSpinBox *mCountSpin;
+    QGridLayout *mGrid;
+    DropGridSummaryModel mSummary;
+};
+
+#endif // DROPTARGETGRID_H
@@ -0,0 +1,192 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "droptimings.h"
+
+#include <QJsonArray>
+
+static QJsonValue nsecsToJson(qint64 nsecs)
+{
+    return nsecs < 0 ? QJsonValue() : QJsonValue(double(nsecs) / 1e6);
+}
+
+static QVariant nsecsToVariant(qint64 nsecs)
+{
+    return nsecs < 0 ? QVariant() : QVariant(QString::number(double(nsecs) / 1e6, 'f', 3));
+}
+
+
+QJsonObject DropTimings::toJson() const
+{
+    QJsonObject o;
+    o["origin"] = origin;
+    o["enterToDropMs"] = nsecsToJson(enterToDropNsecs);
+    if( moveEvents >= 0 ) {
+        o["moveEvents"] = moveEvents;
+        o["moveEventsCached"] = moveEventsCached;
+    }
+    o["formatsMs"] = nsecsToJson(formatsNsecs);
+    o["formatDeadlineMs"] = nsecsToJson(formatDeadlineNsecs);
+    o["modelResetMs"] = nsecsToJson(modelResetNsecs);
+
+    QJsonArray a;
+    for( const auto &f : formats ) {
+        QJsonObject fo;
+        fo["mime"] = f.mime;
+        fo["fetchMs"] = nsecsToJson(f.fetchNsecs);
+        fo["bytes"] = f.bytes < 0 ? QJsonValue() : QJsonValue(double(f.bytes));
+        fo["hashMs"] = nsecsToJson(f.hashNsecs);
+        fo["converted"] = f.converted;
+        fo["timedOut"] = f.timedOut;
+        a.append(fo);
+    }
+    o["formats"] = a;
+
+    return o;
+}
+
+
+
+DropTimingsModel::DropTimingsModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+int DropTimingsModel::rowCount(const QModelIndex &parent) const
+{
+    if( parent.isValid() )
+        return 0;
+
+    return FirstFormatRow + mTimings.formats.size() + 1;
+}
+
+int DropTimingsModel::columnCount(const QModelIndex &) const
+{
+    return 5;
+}
+
+QVariant DropTimingsModel::data(const QModelIndex &index, int role) const
+{
+    if( ! index.isValid() || role != Qt::DisplayRole )
+        return {};
+
+    const int row = index.row();
+    if( row == EnterToDropRow ) {
+        switch( index.column() ) {
+        case 0: return tr("drag enter to drop");
+        case 2: return nsecsToVariant(mTimings.enterToDropNsecs);
+        }
+    } else if( row == MoveEventsRow ) {
+        switch( index.column() ) {
+        case 0: return tr("drag move events");
+        case 1:
+            if( mTimings.moveEvents < 0 )
+                return {};
+            return tr("%1 handled, %2 cached").arg(mTimings.moveEvents - mTimings.moveEventsCached)
+                    .arg(mTimings.moveEventsCached);
+        }
+    } else if( row == FormatsRow ) {
+        switch( index.column() ) {
+        case 0: return tr("formats()");
+        case 2: return nsecsToVariant(mTimings.formatsNsecs);
+        }
+    } else if( row < formatRow(mTimings.formats.size()) ) {
+        const auto &f = mTimings.formats.at(row - FirstFormatRow);
+        switch( index.column() ) {
+        case 0:
+            if( f.timedOut )
+                return f.converted ? tr("conversion (timed out)") : tr("data() (over deadline)");
+            return f.converted ? tr("conversion") : tr("data()");
+        case 1: return f.mime;
+        case 2: return nsecsToVariant(f.fetchNsecs);
+        case 3: return f.bytes < 0 ? QVariant() : QVariant(f.bytes);
+        case 4: return nsecsToVariant(f.hashNsecs);
+        }
+    } else {
+        switch( index.column() ) {
+        case 0: return tr("model reset");
+        case 2: return nsecsToVariant(mTimings.modelResetNsecs);
+        }
+    }
+
+    return {};
+}
+
+QVariant DropTimingsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+        return QVariant();
+
+    switch( section ) {
+    case 0:
+        return tr("Stage");
+    case 1:
+        return tr("MIME");
+    case 2:
+        return tr("Time (ms)");
+    case 3:
+        return tr("Bytes");
+    case 4:
+        return tr("Hash (ms)");
+    }
+
+    return {};
+}
+
+const DropTimings &DropTimingsModel::timings() const
+{
+    return mTimings;
+}
+
+void DropTimingsModel::setTimings(const DropTimings &timings)
+{
+    beginResetModel();
+    mTimings = timings;
+    endResetModel();
+}
+
+void DropTimingsModel::setModelReset(qint64 nsecs)
+{
+    mTimings.modelResetNsecs = nsecs;
+    const int row = formatRow(mTimings.formats.size());
+    emit dataChanged(index(row, 2), index(row, 2));
+}
+
+void DropTimingsModel::setFetched(int format, qint64 nsecs, qint64 bytes)
+{
+    if( format < 0 || format >= mTimings.formats.size() )
+        return;
+
+    mTimings.formats[format].fetchNsecs = nsecs;
+    mTimings.formats[format].bytes = bytes;
+    emit dataChanged(index(formatRow(format), 2), index(formatRow(format), 3));
+}
+
+void DropTimingsModel::setHashed(int format, qint64 nsecs)
+{
+    if( format < 0 || format >= mTimings.formats.size() )
+        return;
+
+    mTimings.formats[format].hashNsecs = nsecs;
+    emit dataChanged(index(formatRow(format), 4), index(formatRow(format), 4));
+}
+
+int DropTimingsModel::formatRow(int format) const
+{
+    return FirstFormatRow + format;
+}
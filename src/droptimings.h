@@ -0,0 +1,93 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DROPTIMINGS_H
+#define DROPTIMINGS_H
+
+#include <QAbstractTableModel>
+#include <QJsonObject>
+#include <QVector>
+
+
+// Timing breakdown of a single drop or clipboard capture. All durations are
+// in nanoseconds, -1 if not measured (yet).
+struct DropTimings
+{
+    struct Format {
+        QString mime;
+        qint64 fetchNsecs = -1;
+        qint64 bytes = -1;
+        qint64 hashNsecs = -1;
+        // Encoded off the GUI thread from a snapshot of the typed value.
+        bool converted = false;
+        // Took longer than the format deadline. Converted formats are not
+        // waited for past it and stay unfetched until first needed.
+        bool timedOut = false;
+    };
+
+    QString origin;
+    qint64 enterToDropNsecs = -1;
+    // Drag move events received, and how many of them reused the previous
+    // accept decision.
+    int moveEvents = -1;
+    int moveEventsCached = -1;
+    qint64 formatsNsecs = -1;
+    qint64 formatDeadlineNsecs = -1;
+    qint64 modelResetNsecs = -1;
+    QVector<Format> formats;
+
+    QJsonObject toJson() const;
+};
+
+Q_DECLARE_METATYPE(DropTimings)
+
+
+class DropTimingsModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit DropTimingsModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    const DropTimings &timings() const;
+
+public slots:
+    void setTimings(const DropTimings &timings);
+    void setModelReset(qint64 nsecs);
+    void setFetched(int format, qint64 nsecs, qint64 bytes);
+    void setHashed(int format, qint64 nsecs);
+
+private:
+    enum FixedRows {
+        EnterToDropRow,
+        MoveEventsRow,
+        FormatsRow,
+        FirstFormatRow
+    };
+
+    int formatRow(int format) const;
+
+    DropTimings mTimings;
+};
+
+#endif // DROPTIMINGS_H
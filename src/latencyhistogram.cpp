@@ -0,0 +1,160 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "latencyhistogram.h"
+
+#include <QTextStream>
+#include <QtAlgorithms>
+
+#include <cmath>
+#include <limits>
+
+// Values below 2^s_linearBits are counted exactly, above that every power of
+// two gets 2^(s_linearBits - 1) sub-buckets.
+static const int s_linearBits = 7;
+static const int s_linearCount = 1 << s_linearBits;
+static const int s_subBucketCount = s_linearCount / 2;
+static const int s_bucketCount = s_linearCount + (63 - s_linearBits) * s_subBucketCount;
+
+static double toMsecs(qint64 nsecs)
+{
+    return double(nsecs) / 1e6;
+}
+
+
+LatencyHistogram::LatencyHistogram()
+{
+    clear();
+}
+
+void LatencyHistogram::record(qint64 nsecs)
+{
+    nsecs = qMax<qint64>(0, nsecs);
+    ++mCounts[bucketIndex(nsecs)];
+    ++mCount;
+    mMin = qMin(mMin, nsecs);
+    mMax = qMax(mMax, nsecs);
+    mSum += double(nsecs);
+}
+
+void LatencyHistogram::clear()
+{
+    mCounts.fill(0, s_bucketCount);
+    mCount = 0;
+    mMin = std::numeric_limits<qint64>::max();
+    mMax = 0;
+    mSum = 0;
+}
+
+qint64 LatencyHistogram::count() const
+{
+    return mCount;
+}
+
+qint64 LatencyHistogram::min() const
+{
+    return mCount > 0 ? mMin : 0;
+}
+
+qint64 LatencyHistogram::max() const
+{
+    return mMax;
+}
+
+double LatencyHistogram::mean() const
+{
+    return mCount > 0 ? mSum / double(mCount) : 0;
+}
+
+qint64 LatencyHistogram::valueAt(double p) const
+{
+    if( mCount == 0 )
+        return 0;
+
+    const qint64 target = qBound<qint64>(1, qint64(std::ceil(p * double(mCount))), mCount);
+    qint64 seen = 0;
+    for( int i = 0; i < mCounts.size(); ++i ) {
+        seen += mCounts.at(i);
+        if( seen >= target )
+            return qBound(min(), highestEquivalentValue(i), mMax);
+    }
+    return mMax;
+}
+
+QJsonObject LatencyHistogram::toJson() const
+{
+    QJsonObject o;
+    o["count"] = double(mCount);
+    o["meanMs"] = mean() / 1e6;
+    o["minMs"] = toMsecs(min());
+    o["p50Ms"] = toMsecs(valueAt(0.5));
+    o["p90Ms"] = toMsecs(valueAt(0.9));
+    o["p99Ms"] = toMsecs(valueAt(0.99));
+    o["p999Ms"] = toMsecs(valueAt(0.999));
+    o["maxMs"] = toMsecs(mMax);
+    return o;
+}
+
+void LatencyHistogram::writeCsvHeader(QTextStream &out)
+{
+    out << "metric,value_ms,percentile,total_count,inverted_percentile\n";
+}
+
+void LatencyHistogram::writeCsv(QTextStream &out, const QString &metric) const
+{
+    QString quoted = metric;
+    quoted.replace('"', "\"\"");
+    quoted = QStringLiteral("\"%1\"").arg(quoted);
+
+    qint64 seen = 0;
+    for( int i = 0; i < mCounts.size(); ++i ) {
+        if( mCounts.at(i) == 0 )
+            continue;
+
+        seen += mCounts.at(i);
+        const double p = double(seen) / double(mCount);
+        out << quoted << ','
+            << QString::number(toMsecs(qMin(highestEquivalentValue(i), mMax)), 'f', 6) << ','
+            << QString::number(p, 'f', 6) << ','
+            << seen << ',';
+        if( seen < mCount )
+            out << QString::number(1.0 / (1.0 - p), 'f', 2);
+        out << '\n';
+    }
+}
+
+int LatencyHistogram::bucketIndex(qint64 nsecs)
+{
+    if( nsecs < s_linearCount )
+        return int(nsecs);
+
+    const int exponent = 63 - qCountLeadingZeroBits(quint64(nsecs));
+    const int shift = exponent - (s_linearBits - 1);
+    const int sub = int(nsecs >> shift) - s_subBucketCount;
+    return s_linearCount + (exponent - s_linearBits) * s_subBucketCount + sub;
+}
+
+qint64 LatencyHistogram::highestEquivalentValue(int index)
+{
+    if( index < s_linearCount )
+        return index;
+
+    const int exponent = (index - s_linearCount) / s_subBucketCount + s_linearBits;
+    const int shift = exponent - (s_linearBits - 1);
+    const qint64 sub = (index - s_linearCount) % s_subBucketCount + s_subBucketCount;
+    return (sub << shift) + (qint64(1) << shift) - 1;
+}
@@ -0,0 +1,64 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QJsonObject>
+#include <QVector>
+
+class QTextStream;
+
+
+// Log-linear histogram in the style of HdrHistogram: values are bucketed by
+// power of two and every power is split into linear sub-buckets, so the
+// relative error stays below 1/64 over the whole range while the memory used
+// does not grow with the number of recorded values. Values are nanoseconds.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 nsecs);
+    void clear();
+
+    qint64 count() const;
+    qint64 min() const;
+    qint64 max() const;
+    double mean() const;
+    // Highest value equivalent to the one at percentile p in [0, 1].
+    qint64 valueAt(double p) const;
+
+    // count, mean, min, p50, p90, p99, p99.9 and max in milliseconds.
+    QJsonObject toJson() const;
+    // Percentile distribution, one row per used bucket:
+    // metric,value_ms,percentile,total_count,inverted_percentile
+    void writeCsv(QTextStream &out, const QString &metric) const;
+    static void writeCsvHeader(QTextStream &out);
+
+private:
+    static int bucketIndex(qint64 nsecs);
+    static qint64 highestEquivalentValue(int index);
+
+    QVector<qint64> mCounts;
+    qint64 mCount;
+    qint64 mMin;
+    qint64 mMax;
+    double mSum;
+};
+
+#endif // LATENCYHISTOGRAM_H
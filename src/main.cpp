@@ -1,13 +1,83 @@
+#include "batchrunner.h"
 #include "dragsource.h"
+#include "dragsourceconfig.h"
 #include "droparea.h"
+#include "metricslog.h"
 #include "widget.h"
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QJsonDocument>
+#include <QTextStream>
 
 #include "config.h"
 
+static int runBatch(const QCommandLineParser &parser, const QString &configFile)
+{
+    DragSourceModel model;
+    QString error;
+    if( ! DragSourceConfig::load(configFile, model, &error) ) {
+        qCritical("%s: %s", qPrintable(configFile), qPrintable(error));
+        return 1;
+    }
+
+    BatchRunner runner;
+    BatchRunner::Mode mode;
+    if( ! BatchRunner::modeFromString(parser.value("mode"), &mode) ) {
+        qCritical("Unknown batch mode %s", qPrintable(parser.value("mode")));
+        return 1;
+    }
+    runner.setMode(mode);
+    runner.setIterations(parser.value("iterations").toInt());
+    runner.setSettleMsecs(parser.value("settle").toInt());
+    runner.setPromiseMode(! parser.isSet("eager"));
+
+    QJsonObject report;
+    report["config"] = configFile;
+    const bool ok = runner.run(model, &report);
+
+    const QByteArray json = QJsonDocument(report).toJson();
+    const QString reportFile = parser.value("report");
+    if( reportFile.isEmpty() ) {
+        QTextStream(stdout) << json;
+    } else {
+        QFile f(reportFile);
+        if( ! f.open(QIODevice::WriteOnly) || f.write(json) != json.size() ) {
+            qCritical("Cannot write report %s", qPrintable(reportFile));
+            return 1;
+        }
+    }
+
+    return ok ? 0 : 2;
+}
+
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setApplicationName("DragonDropTest");
+    a.setApplicationVersion(DRAGONDROPTEST_VERSION_STRING);
+
+    const QString metricsLog = QString::fromLocal8Bit(qgetenv("DRAGONDROPTEST_METRICS_LOG"));
+    if( ! metricsLog.isEmpty() )
+        MetricsLog::instance().open(metricsLog);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Drag and drop / clipboard test tool.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOptions({
+        {"batch", "Replay all drag sources of a .dndtest file without UI and exit; "
+                  "exits with 2 if data was lost or changed.", "config"},
+        {"mode", "Batch round trip through the clipboard or a local drag: clipboard, drag.", "mode", "clipboard"},
+        {"iterations", "Batch round trips per drag source.", "count", "1"},
+        {"settle", "Batch: milliseconds each entry stays on the clipboard before it is read back.", "msecs", "0"},
+        {"eager", "Batch: provide all formats up front instead of on request."},
+        {"report", "Batch: write the JSON report to this file instead of stdout.", "file"}
+    });
+    parser.process(a);
+
+    if( parser.isSet("batch") )
+        return runBatch(parser, parser.value("batch"));
 
     Widget w;
     w.setWindowTitle("DragonDropTest " DRAGONDROPTEST_VERSION_STRING);
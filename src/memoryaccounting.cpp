@@ -0,0 +1,350 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "memoryaccounting.h"
+
+#include "metricslog.h"
+
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <QSet>
+
+#include <algorithm>
+
+static QVariant bytesToVariant(qint64 bytes)
+{
+    return QString::number(double(bytes) / 1024, 'f', 1);
+}
+
+static QVector<MemoryAccounting::Holding> nonEmpty(const QVector<MemoryAccounting::Holding> &holdings)
+{
+    QVector<MemoryAccounting::Holding> res;
+    for( const auto &holding : holdings ) {
+        if( holding.data && holding.bytes > 0 )
+            res.append(holding);
+    }
+    return res;
+}
+
+
+MemoryAccounting::Holding MemoryAccounting::Holding::of(const Payload &payload)
+{
+    Holding h;
+    h.data = payload.constData();
+    h.bytes = payload.size();
+    h.mapped = payload.isMapped();
+    return h;
+}
+
+MemoryAccounting::Holding MemoryAccounting::Holding::of(const QByteArray &bytes)
+{
+    Holding h;
+    h.data = bytes.constData();
+    h.bytes = bytes.size();
+    return h;
+}
+
+QJsonObject MemoryAccounting::Snapshot::toJson() const
+{
+    QJsonObject o;
+    o["totalBytes"] = double(totalBytes);
+    o["mappedBytes"] = double(mappedBytes);
+    o["peakTotalBytes"] = double(peakTotalBytes);
+
+    QJsonArray a;
+    for( const auto &owner : owners ) {
+        QJsonObject oo;
+        oo["owner"] = owner.name;
+        oo["holders"] = owner.holders;
+        oo["heldBytes"] = double(owner.heldBytes);
+        oo["uniqueBytes"] = double(owner.uniqueBytes);
+        oo["sharedBytes"] = double(owner.sharedBytes);
+        oo["mappedBytes"] = double(owner.mappedBytes);
+        oo["peakBytes"] = double(owner.peakBytes);
+        a.append(oo);
+    }
+    o["owners"] = a;
+
+    return o;
+}
+
+MemoryAccounting &MemoryAccounting::instance()
+{
+    static MemoryAccounting accounting;
+    return accounting;
+}
+
+MemoryAccounting::MemoryAccounting()
+{
+}
+
+void MemoryAccounting::setHoldings(const void *holder, const QString &owner, const QVector<Holding> &holdings)
+{
+    QMutexLocker lock(&mMutex);
+
+    Holder &h = mHolders[holder];
+    h.owner = owner;
+    h.holdings = nonEmpty(holdings);
+    h.provider = nullptr;
+    update();
+}
+
+void MemoryAccounting::holdUntilDestroyed(QObject *holder, const QString &owner, const QVector<Holding> &holdings)
+{
+    setHoldings(holder, owner, holdings);
+    QObject::connect(holder, &QObject::destroyed, [this, holder]() { release(holder); });
+}
+
+void MemoryAccounting::setProvider(const void *holder, const QString &owner, const Provider &provider)
+{
+    {
+        QMutexLocker lock(&mMutex);
+        Holder &h = mHolders[holder];
+        h.owner = owner;
+        h.provider = provider;
+    }
+
+    query({ qMakePair(holder, provider) });
+}
+
+void MemoryAccounting::refresh(const void *holder)
+{
+    Provider provider;
+    {
+        QMutexLocker lock(&mMutex);
+        provider = mHolders.value(holder).provider;
+    }
+
+    if( provider )
+        query({ qMakePair(holder, provider) });
+}
+
+void MemoryAccounting::refresh()
+{
+    QVector<QPair<const void *, Provider>> providers;
+    {
+        QMutexLocker lock(&mMutex);
+        for( auto it = mHolders.cbegin(); it != mHolders.cend(); ++it ) {
+            if( it->provider )
+                providers.append(qMakePair(it.key(), it->provider));
+        }
+    }
+
+    query(providers);
+}
+
+void MemoryAccounting::release(const void *holder)
+{
+    QMutexLocker lock(&mMutex);
+
+    if( mHolders.remove(holder) > 0 )
+        update();
+}
+
+// Providers run without the lock, they may touch entries that account.
+void MemoryAccounting::query(const QVector<QPair<const void *, Provider>> &providers)
+{
+    QVector<QVector<Holding>> results;
+    for( const auto &p : providers )
+        results.append(nonEmpty(p.second()));
+
+    QMutexLocker lock(&mMutex);
+    for( int i = 0; i < providers.size(); ++i ) {
+        auto it = mHolders.find(providers.at(i).first);
+        if( it != mHolders.end() )
+            it->holdings = results.at(i);
+    }
+    update();
+}
+
+MemoryAccounting::Snapshot MemoryAccounting::snapshot() const
+{
+    QMutexLocker lock(&mMutex);
+    return mSnapshot;
+}
+
+// Recomputed from scratch on every change; holders report whole drops or
+// configs, so changes are rare compared to the number of holdings.
+void MemoryAccounting::update()
+{
+    struct Data {
+        qint64 bytes = 0;
+        bool mapped = false;
+        QString owner;
+        bool shared = false;
+    };
+
+    QHash<const void *, Data> data;
+    QHash<QString, QSet<const void *>> ownerData;
+    QHash<QString, Owner> owners;
+    for( const auto &holder : mHolders ) {
+        Owner &o = owners[holder.owner];
+        o.name = holder.owner;
+        ++o.holders;
+
+        QSet<const void *> &held = ownerData[holder.owner];
+        for( const auto &holding : holder.holdings ) {
+            o.heldBytes += holding.bytes;
+            held.insert(holding.data);
+
+            Data &d = data[holding.data];
+            // Views may cover only part of the data.
+            d.bytes = qMax(d.bytes, holding.bytes);
+            d.mapped = holding.mapped;
+            if( d.owner.isNull() )
+                d.owner = holder.owner;
+            else if( d.owner != holder.owner )
+                d.shared = true;
+        }
+    }
+
+    Snapshot s;
+    for( auto it = data.cbegin(); it != data.cend(); ++it ) {
+        if( it->mapped )
+            s.mappedBytes += it->bytes;
+        else
+            s.totalBytes += it->bytes;
+    }
+    s.peakTotalBytes = qMax(mSnapshot.peakTotalBytes, s.totalBytes);
+
+    QHash<QString, qint64> peaks;
+    for( const auto &o : mSnapshot.owners )
+        peaks.insert(o.name, o.peakBytes);
+
+    for( auto it = owners.begin(); it != owners.end(); ++it ) {
+        Owner &o = it.value();
+        for( const void *ptr : ownerData.value(o.name) ) {
+            const Data &d = data[ptr];
+            if( d.mapped )
+                o.mappedBytes += d.bytes;
+            else if( d.shared )
+                o.sharedBytes += d.bytes;
+            else
+                o.uniqueBytes += d.bytes;
+        }
+        o.peakBytes = qMax(peaks.take(o.name), o.uniqueBytes + o.sharedBytes);
+        s.owners.append(o);
+    }
+
+    // Owners without holders keep their high-water mark.
+    for( auto it = peaks.cbegin(); it != peaks.cend(); ++it ) {
+        Owner o;
+        o.name = it.key();
+        o.peakBytes = it.value();
+        s.owners.append(o);
+    }
+
+    std::sort(s.owners.begin(), s.owners.end(), [](const Owner &a, const Owner &b) {
+        return a.name < b.name;
+    });
+    mSnapshot = s;
+}
+
+
+
+MemoryAccountingModel::MemoryAccountingModel(QObject *parent)
+    : QAbstractTableModel(parent)
+    , mLoggedPeak(0)
+{
+    refresh();
+}
+
+int MemoryAccountingModel::rowCount(const QModelIndex &parent) const
+{
+    if( parent.isValid() )
+        return 0;
+
+    return mSnapshot.owners.size() + 1;
+}
+
+int MemoryAccountingModel::columnCount(const QModelIndex &) const
+{
+    return 7;
+}
+
+QVariant MemoryAccountingModel::data(const QModelIndex &index, int role) const
+{
+    if( ! index.isValid() || role != Qt::DisplayRole )
+        return {};
+
+    if( index.row() == mSnapshot.owners.size() ) {
+        switch( index.column() ) {
+        case 0: return tr("total");
+        case 3: return bytesToVariant(mSnapshot.totalBytes);
+        case 5: return bytesToVariant(mSnapshot.mappedBytes);
+        case 6: return bytesToVariant(mSnapshot.peakTotalBytes);
+        }
+        return {};
+    }
+
+    const auto &o = mSnapshot.owners.at(index.row());
+    switch( index.column() ) {
+    case 0: return o.name;
+    case 1: return o.holders;
+    case 2: return bytesToVariant(o.heldBytes);
+    case 3: return bytesToVariant(o.uniqueBytes);
+    case 4: return bytesToVariant(o.sharedBytes);
+    case 5: return bytesToVariant(o.mappedBytes);
+    case 6: return bytesToVariant(o.peakBytes);
+    }
+
+    return {};
+}
+
+QVariant MemoryAccountingModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if( orientation != Qt::Horizontal || role != Qt::DisplayRole )
+        return QVariant();
+
+    switch( section ) {
+    case 0:
+        return tr("Owner");
+    case 1:
+        return tr("Holders");
+    case 2:
+        return tr("Held (KiB)");
+    case 3:
+        return tr("Unique (KiB)");
+    case 4:
+        return tr("Shared (KiB)");
+    case 5:
+        return tr("Mapped (KiB)");
+    case 6:
+        return tr("Peak (KiB)");
+    }
+
+    return {};
+}
+
+void MemoryAccountingModel::refresh()
+{
+    const MemoryAccounting::Snapshot s = MemoryAccounting::instance().snapshot();
+
+    if( s.owners.size() == mSnapshot.owners.size() ) {
+        mSnapshot = s;
+        emit dataChanged(index(0, 0), index(rowCount() - 1, columnCount() - 1));
+    } else {
+        beginResetModel();
+        mSnapshot = s;
+        endResetModel();
+    }
+
+    if( mSnapshot.peakTotalBytes > mLoggedPeak ) {
+        mLoggedPeak = mSnapshot.peakTotalBytes;
+        MetricsLog::instance().write("memory", mSnapshot.toJson());
+    }
+}
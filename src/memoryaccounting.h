@@ -0,0 +1,134 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include "payload.h"
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QJsonObject>
+#include <QMutex>
+#include <QVector>
+
+#include <functional>
+
+
+// Process wide record of which payload data is held by whom. Holders, e.g. a
+// model or an editor widget, report everything they currently hold under an
+// owner name; data is identified by its address, so implicitly shared byte
+// arrays and payloads held by several holders are counted once and reported
+// as shared between their owners. Nothing is ever fetched or converted just
+// to be measured.
+//
+// Holders of lazy entries register a provider instead, which is queried
+// again whenever an entry was fetched, wherever that happened.
+class MemoryAccounting
+{
+public:
+    struct Holding {
+        const void *data = nullptr;
+        qint64 bytes = 0;
+        // Mapped from a file, so it does not pin anonymous memory.
+        bool mapped = false;
+
+        static Holding of(const Payload &payload);
+        static Holding of(const QByteArray &bytes);
+    };
+
+    struct Owner {
+        QString name;
+        int holders = 0;
+        // Sum over all holdings, as if nothing was shared.
+        qint64 heldBytes = 0;
+        // Distinct heap data held by this owner only, resp. also by others.
+        qint64 uniqueBytes = 0;
+        qint64 sharedBytes = 0;
+        qint64 mappedBytes = 0;
+        // High-water mark of unique plus shared bytes.
+        qint64 peakBytes = 0;
+    };
+
+    struct Snapshot {
+        QVector<Owner> owners;
+        // Distinct heap data of all owners.
+        qint64 totalBytes = 0;
+        qint64 mappedBytes = 0;
+        qint64 peakTotalBytes = 0;
+
+        QJsonObject toJson() const;
+    };
+
+    typedef std::function<QVector<Holding>()> Provider;
+
+    static MemoryAccounting &instance();
+
+    // Replaces what holder holds.
+    void setHoldings(const void *holder, const QString &owner, const QVector<Holding> &holdings);
+    // Released once holder is destroyed, e.g. mime data handed to Qt.
+    void holdUntilDestroyed(QObject *holder, const QString &owner, const QVector<Holding> &holdings);
+    // Queries provider now and on every refresh; GUI thread only.
+    void setProvider(const void *holder, const QString &owner, const Provider &provider);
+    // Queries the provider of holder again, resp. those of all holders.
+    void refresh(const void *holder);
+    void refresh();
+    void release(const void *holder);
+
+    Snapshot snapshot() const;
+
+private:
+    struct Holder {
+        QString owner;
+        QVector<Holding> holdings;
+        Provider provider;
+    };
+
+    MemoryAccounting();
+
+    void query(const QVector<QPair<const void *, Provider>> &providers);
+    void update();
+
+    mutable QMutex mMutex;
+    QHash<const void *, Holder> mHolders;
+    Snapshot mSnapshot;
+};
+
+
+// Status table of the memory accounting, one row per owner and a total.
+// New high-water marks of the total are written to the metrics log.
+class MemoryAccountingModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    explicit MemoryAccountingModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+public slots:
+    void refresh();
+
+private:
+    MemoryAccounting::Snapshot mSnapshot;
+    qint64 mLoggedPeak;
+};
+
+#endif // MEMORYACCOUNTING_H
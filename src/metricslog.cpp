@@ -0,0 +1,70 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "metricslog.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QMutexLocker>
+
+
+MetricsLog &MetricsLog::instance()
+{
+    static MetricsLog log;
+    return log;
+}
+
+MetricsLog::MetricsLog()
+{
+}
+
+bool MetricsLog::open(const QString &fileName)
+{
+    QMutexLocker lock(&mMutex);
+
+    if( mFile.isOpen() )
+        mFile.close();
+
+    mFile.setFileName(fileName);
+    if( ! mFile.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text) ) {
+        qWarning("Cannot open metrics log %s", qPrintable(fileName));
+        return false;
+    }
+
+    return true;
+}
+
+bool MetricsLog::isOpen() const
+{
+    QMutexLocker lock(&mMutex);
+    return mFile.isOpen();
+}
+
+void MetricsLog::write(const QString &type, QJsonObject record)
+{
+    QMutexLocker lock(&mMutex);
+
+    if( ! mFile.isOpen() )
+        return;
+
+    record.insert("type", type);
+    record.insert("time", double(QDateTime::currentMSecsSinceEpoch()));
+    mFile.write(QJsonDocument(record).toJson(QJsonDocument::Compact));
+    mFile.write("\n");
+    mFile.flush();
+}
@@ -0,0 +1,46 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef METRICSLOG_H
+#define METRICSLOG_H
+
+#include <QFile>
+#include <QJsonObject>
+#include <QMutex>
+
+
+// Machine readable log with one JSON object per line. Every record carries
+// its type and a timestamp; nothing is written unless a log file is opened.
+class MetricsLog
+{
+public:
+    static MetricsLog &instance();
+
+    bool open(const QString &fileName);
+    bool isOpen() const;
+
+    void write(const QString &type, QJsonObject record);
+
+private:
+    MetricsLog();
+
+    mutable QMutex mMutex;
+    QFile mFile;
+};
+
+#endif // METRICSLOG_H
@@ -0,0 +1,414 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payload.h"
+
+#include "chunkedhash.h"
+
+#include <QDir>
+#include <QMutexLocker>
+#include <QTemporaryFile>
+
+#include <limits>
+
+static qint64 s_spillThreshold = 16 * 1024 * 1024;
+static const qint64 s_minMapSize = 64 * 1024;
+
+
+class PayloadStorage
+{
+public:
+    virtual ~PayloadStorage() {}
+
+    virtual bool isMapped() const { return false; }
+    virtual QByteArray toByteArray() const
+    {
+        if( size > std::numeric_limits<int>::max() ) {
+            qWarning("Payload of %lld bytes does not fit into a QByteArray", size);
+            return {};
+        }
+        return QByteArray(data, int(size));
+    }
+
+    virtual QString fileName() const { return {}; }
+
+    const char *data = nullptr;
+    qint64 size = 0;
+    qint64 fileOffset = 0;
+
+    mutable QMutex keyMutex;
+    mutable QByteArray contentKey;
+};
+
+namespace {
+
+class HeapStorage : public PayloadStorage
+{
+public:
+    explicit HeapStorage(const QByteArray &bytes)
+        : mBytes(bytes)
+    {
+        data = mBytes.constData();
+        size = mBytes.size();
+    }
+
+    QByteArray toByteArray() const override { return mBytes; }
+
+private:
+    QByteArray mBytes;
+};
+
+class TempFileStorage : public PayloadStorage
+{
+public:
+    TempFileStorage(QTemporaryFile *file, uchar *map, qint64 len)
+        : mFile(file), mMap(map)
+    {
+        data = reinterpret_cast<const char *>(mMap);
+        size = len;
+    }
+
+    ~TempFileStorage()
+    {
+        mFile->unmap(mMap);
+    }
+
+    bool isMapped() const override { return true; }
+    QString fileName() const override { return mFile->fileName(); }
+
+private:
+    QScopedPointer<QTemporaryFile> mFile;
+    uchar *mMap;
+};
+
+}
+
+class FileRegionStorage : public PayloadStorage
+{
+public:
+    FileRegionStorage(const QSharedPointer<PayloadFile> &file, uchar *map, qint64 offset, qint64 len)
+        : mFile(file), mMap(map)
+    {
+        data = reinterpret_cast<const char *>(mMap);
+        size = len;
+        fileOffset = offset;
+    }
+
+    ~FileRegionStorage()
+    {
+        mFile->unmap(mMap);
+    }
+
+    bool isMapped() const override { return true; }
+    QString fileName() const override { return mFile->fileName(); }
+
+private:
+    QSharedPointer<PayloadFile> mFile;
+    uchar *mMap;
+};
+
+
+Payload::Payload()
+{
+}
+
+Payload::Payload(const PayloadStorage *storage)
+    : d(storage)
+{
+}
+
+Payload Payload::fromByteArray(const QByteArray &data)
+{
+    return fromHeap(data).spilled();
+}
+
+Payload Payload::fromHeap(const QByteArray &data)
+{
+    return Payload(new HeapStorage(data));
+}
+
+bool Payload::isNull() const
+{
+    return d.isNull();
+}
+
+bool Payload::isMapped() const
+{
+    return d && d->isMapped();
+}
+
+qint64 Payload::size() const
+{
+    return d ? d->size : 0;
+}
+
+const char *Payload::constData() const
+{
+    return d ? d->data : nullptr;
+}
+
+QByteArray Payload::toByteArray() const
+{
+    return d ? d->toByteArray() : QByteArray();
+}
+
+QByteArray Payload::view() const
+{
+    if( ! d )
+        return {};
+    if( ! d->isMapped() )
+        return d->toByteArray();
+    if( d->size > std::numeric_limits<int>::max() ) {
+        qWarning("Payload of %lld bytes does not fit into a QByteArray", d->size);
+        return {};
+    }
+
+    return QByteArray::fromRawData(d->data, int(d->size));
+}
+
+QString Payload::fileName() const
+{
+    return d ? d->fileName() : QString();
+}
+
+qint64 Payload::fileOffset() const
+{
+    return d ? d->fileOffset : 0;
+}
+
+QByteArray Payload::contentKey() const
+{
+    if( ! d )
+        return {};
+
+    QMutexLocker lock(&d->keyMutex);
+    if( d->contentKey.isEmpty() ) {
+        ChunkedHash hash(ChunkedHash::XxHash64);
+        hash.addData(d->data, d->size);
+        d->contentKey = hash.result() + QByteArray::number(d->size);
+    }
+
+    return d->contentKey;
+}
+
+bool Payload::isSharedWith(const Payload &other) const
+{
+    return d == other.d;
+}
+
+Payload Payload::spilled() const
+{
+    if( ! d || d->isMapped() || d->size <= s_spillThreshold )
+        return *this;
+
+    Writer w(d->size);
+    w.append(d->data, d->size);
+    Payload p = w.finish();
+    if( p.isNull() )
+        return *this;
+
+    // The bytes are the same, a key computed before spilling still holds.
+    QMutexLocker lock(&d->keyMutex);
+    p.d->contentKey = d->contentKey;
+    return p;
+}
+
+qint64 Payload::spillThreshold()
+{
+    return s_spillThreshold;
+}
+
+void Payload::setSpillThreshold(qint64 bytes)
+{
+    s_spillThreshold = bytes;
+}
+
+
+
+Payload::Writer::Writer(qint64 expectedSize)
+    : mSize(0)
+    , mFailed(false)
+{
+    if( expectedSize > s_spillThreshold )
+        spill();
+    else if( expectedSize > 0 )
+        mBuffer.reserve(int(expectedSize));
+}
+
+Payload::Writer::~Writer()
+{
+}
+
+bool Payload::Writer::append(const char *data, qint64 len)
+{
+    if( mFailed )
+        return false;
+
+    if( ! mFile && mSize + len > s_spillThreshold )
+        spill();
+
+    if( mFile ) {
+        if( mFile->write(data, len) != len ) {
+            qWarning("Cannot write payload to %s", qPrintable(mFile->fileName()));
+            mFailed = true;
+            return false;
+        }
+    } else {
+        if( mSize + len > std::numeric_limits<int>::max() ) {
+            mFailed = true;
+            return false;
+        }
+        mBuffer.append(data, int(len));
+    }
+
+    mSize += len;
+    return true;
+}
+
+bool Payload::Writer::append(const QByteArray &data)
+{
+    return append(data.constData(), data.size());
+}
+
+qint64 Payload::Writer::size() const
+{
+    return mSize;
+}
+
+Payload Payload::Writer::finish()
+{
+    if( mFailed )
+        return Payload();
+
+    if( ! mFile || mSize == 0 ) {
+        const Payload p(new HeapStorage(mBuffer));
+        mBuffer.clear();
+        return p;
+    }
+
+    mFile->flush();
+    uchar *map = mFile->map(0, mSize);
+    if( ! map ) {
+        qWarning("Cannot map payload file %s", qPrintable(mFile->fileName()));
+        if( mSize > std::numeric_limits<int>::max() || ! mFile->seek(0) )
+            return Payload();
+        return Payload(new HeapStorage(mFile->readAll()));
+    }
+
+    return Payload(new TempFileStorage(mFile.take(), map, mSize));
+}
+
+bool Payload::Writer::spill()
+{
+    QScopedPointer<QTemporaryFile> file(new QTemporaryFile(QDir::tempPath() + "/DragonDropTest-payload-XXXXXX"));
+    if( ! file->open() ) {
+        qWarning("Cannot create payload spill file, keeping payload in memory");
+        return false;
+    }
+
+    if( file->write(mBuffer) != mBuffer.size() ) {
+        qWarning("Cannot write payload spill file %s, keeping payload in memory", qPrintable(file->fileName()));
+        return false;
+    }
+
+    mBuffer.clear();
+    mFile.swap(file);
+    return true;
+}
+
+
+
+QSharedPointer<PayloadFile> PayloadFile::open(const QString &fileName)
+{
+    QSharedPointer<PayloadFile> file(new PayloadFile);
+    file->mFile.setFileName(fileName);
+    if( ! file->mFile.open(QIODevice::ReadOnly) )
+        return {};
+
+    return file;
+}
+
+PayloadFile::PayloadFile()
+{
+}
+
+QString PayloadFile::fileName() const
+{
+    return mFile.fileName();
+}
+
+qint64 PayloadFile::size() const
+{
+    QMutexLocker lock(&mMutex);
+    return mFile.size();
+}
+
+Payload PayloadFile::map(qint64 offset, qint64 size)
+{
+    QMutexLocker lock(&mMutex);
+
+    if( offset < 0 || size < 0 || offset + size > mFile.size() ) {
+        qWarning("Region %lld+%lld is out of range of %s", offset, size, qPrintable(mFile.fileName()));
+        return Payload();
+    }
+
+    if( size < s_minMapSize ) {
+        if( ! mFile.seek(offset) )
+            return Payload();
+        const QByteArray bytes = mFile.read(size);
+        if( bytes.size() != size )
+            return Payload();
+        return Payload(new HeapStorage(bytes));
+    }
+
+    uchar *address = mFile.map(offset, size);
+    if( ! address ) {
+        qWarning("Cannot map region of %s", qPrintable(mFile.fileName()));
+        return Payload();
+    }
+
+    return Payload(new FileRegionStorage(sharedFromThis(), address, offset, size));
+}
+
+void PayloadFile::unmap(uchar *address)
+{
+    QMutexLocker lock(&mMutex);
+    mFile.unmap(address);
+}
+
+
+
+FileRegionSource::FileRegionSource(const QSharedPointer<PayloadFile> &file, qint64 offset, qint64 size)
+    : mFile(file), mOffset(offset), mSize(size)
+{
+}
+
+bool FileRegionSource::isAvailable() const
+{
+    return true;
+}
+
+qint64 FileRegionSource::sizeHint() const
+{
+    return mSize;
+}
+
+Payload FileRegionSource::fetch(const QString &)
+{
+    return mFile->map(mOffset, mSize);
+}
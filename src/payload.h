@@ -0,0 +1,167 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QVariantMap>
+
+class QTemporaryFile;
+class PayloadFile;
+class PayloadStorage;
+
+
+// Immutable, implicitly shared block of bytes. Small payloads live on the
+// heap, large ones are spilled to a memory mapped temporary file so that the
+// kernel can page them out instead of pinning anonymous memory.
+class Payload
+{
+public:
+    Payload();
+
+    static Payload fromByteArray(const QByteArray &data);
+    // Shares data without spilling, see spilled().
+    static Payload fromHeap(const QByteArray &data);
+
+    bool isNull() const;
+    bool isMapped() const;
+    qint64 size() const;
+    const char *constData() const;
+
+    // Deep copies mapped payloads, shares heap payloads.
+    QByteArray toByteArray() const;
+    // Read-only view without copy; only valid while this payload is alive.
+    QByteArray view() const;
+
+    // File the data is mapped from, empty for heap payloads.
+    QString fileName() const;
+    qint64 fileOffset() const;
+
+    // XXH64 digest of the data followed by its size, computed once per
+    // shared payload. See PayloadStore.
+    QByteArray contentKey() const;
+    bool isSharedWith(const Payload &other) const;
+
+    // Heap payloads beyond the spill threshold are copied to a mapped
+    // temporary file, anything else is returned as is.
+    Payload spilled() const;
+
+    static qint64 spillThreshold();
+    static void setSpillThreshold(qint64 bytes);
+
+    class Writer;
+
+private:
+    explicit Payload(const PayloadStorage *storage);
+
+    QSharedPointer<const PayloadStorage> d;
+
+    friend class PayloadFile;
+    friend class PayloadStore;
+};
+
+
+// Incrementally builds a payload; spills to a temporary file as soon as the
+// data grows beyond the spill threshold.
+class Payload::Writer
+{
+public:
+    explicit Writer(qint64 expectedSize = -1);
+    ~Writer();
+
+    bool append(const char *data, qint64 len);
+    bool append(const QByteArray &data);
+    qint64 size() const;
+
+    Payload finish();
+
+private:
+    bool spill();
+
+    QByteArray mBuffer;
+    QScopedPointer<QTemporaryFile> mFile;
+    qint64 mSize;
+    bool mFailed;
+};
+
+
+// Read-only file that payloads map regions of, e.g. a drag source config.
+// The file stays open as long as a payload or handle refers to it.
+class PayloadFile : public QEnableSharedFromThis<PayloadFile>
+{
+public:
+    static QSharedPointer<PayloadFile> open(const QString &fileName);
+
+    QString fileName() const;
+    qint64 size() const;
+
+    // Thread-safe; small regions are read into memory instead of mapped.
+    Payload map(qint64 offset, qint64 size);
+
+private:
+    PayloadFile();
+
+    void unmap(uchar *address);
+
+    mutable QMutex mMutex;
+    QFile mFile;
+
+    friend class FileRegionStorage;
+};
+
+
+// Produces payloads on demand, e.g. from a QMimeData that is still alive.
+// Sources are only used from the GUI thread.
+class PayloadSource
+{
+public:
+    virtual ~PayloadSource() {}
+
+    virtual bool isAvailable() const = 0;
+    virtual qint64 sizeHint() const { return -1; }
+    virtual Payload fetch(const QString &mime) = 0;
+
+    // Sources that can cheaply reproduce their data are not cached.
+    virtual bool isCacheable() const { return true; }
+    // Non-empty for procedurally generated data, see PayloadGenerator.
+    virtual QVariantMap generatorSpec() const { return {}; }
+};
+
+
+// Serves a fixed region of a payload file.
+class FileRegionSource : public PayloadSource
+{
+public:
+    FileRegionSource(const QSharedPointer<PayloadFile> &file, qint64 offset, qint64 size);
+
+    bool isAvailable() const override;
+    qint64 sizeHint() const override;
+    Payload fetch(const QString &mime) override;
+
+private:
+    QSharedPointer<PayloadFile> mFile;
+    qint64 mOffset;
+    qint64 mSize;
+};
+
+#endif // PAYLOAD_H
@@ -0,0 +1,427 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "payloaddecoder.h"
+
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QMutex>
+#include <QRegularExpression>
+#include <QRunnable>
+#include <QTextCodec>
+
+#include <cstring>
+#include <limits>
+
+// Bytes of text looked at for charset declarations and similar.
+static const qint64 s_prescanBytes = 64 * 1024;
+static const qint64 s_cancelCheckBytes = 1024 * 1024;
+
+static QString tr(const char *text, int n = -1)
+{
+    return QCoreApplication::translate("PayloadDecoder", text, 0, n);
+}
+
+static const uchar *payloadData(const Payload &payload)
+{
+    return reinterpret_cast<const uchar *>(payload.constData());
+}
+
+static QString mimeCharset(const QString &mime)
+{
+    static const QRegularExpression charset("charset\\s*=\\s*\"?([^\";\\s]+)",
+                                            QRegularExpression::CaseInsensitiveOption);
+    return charset.match(mime).captured(1).toUpper();
+}
+
+static QString bomCharset(const uchar *data, qint64 size, int *bomLength)
+{
+    *bomLength = 0;
+    if( size >= 3 && data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf ) {
+        *bomLength = 3;
+        return "UTF-8";
+    }
+    if( size >= 2 && data[0] == 0xff && data[1] == 0xfe ) {
+        *bomLength = 2;
+        return "UTF-16LE";
+    }
+    if( size >= 2 && data[0] == 0xfe && data[1] == 0xff ) {
+        *bomLength = 2;
+        return "UTF-16BE";
+    }
+    return {};
+}
+
+// Mostly ASCII text in UTF-16 has a zero in every other byte.
+static QString guessUtf16(const uchar *data, qint64 size)
+{
+    const qint64 pairs = qMin(size, s_prescanBytes) / 2;
+    if( pairs == 0 )
+        return {};
+
+    qint64 evenZeros = 0, oddZeros = 0;
+    for( qint64 i = 0; i < pairs; ++i ) {
+        evenZeros += data[2 * i] == 0;
+        oddZeros += data[2 * i + 1] == 0;
+    }
+    if( oddZeros * 10 > pairs * 4 && evenZeros * 10 < pairs )
+        return "UTF-16LE";
+    if( evenZeros * 10 > pairs * 4 && oddZeros * 10 < pairs )
+        return "UTF-16BE";
+    return {};
+}
+
+static QString elide(QString text, int length)
+{
+    text = text.simplified();
+    if( text.size() > length )
+        text = text.left(length - 3) + "...";
+    return text;
+}
+
+
+namespace {
+
+class UriListDecoder : public PayloadDecoder
+{
+public:
+    bool accepts(const QString &mime) const override
+    {
+        return mime.startsWith("text/uri-list");
+    }
+
+    // The URL count needs the whole list, but only finds line breaks.
+    Info decode(const QString &, const Payload &payload, const QAtomicInt *cancel) const override
+    {
+        const char *data = payload.constData();
+        const qint64 size = payload.size();
+
+        int urls = 0;
+        QByteArray first;
+        qint64 pos = 0;
+        qint64 nextCancelCheck = s_cancelCheckBytes;
+        while( pos < size ) {
+            const void *nl = std::memchr(data + pos, '\n', size_t(size - pos));
+            const qint64 end = nl ? static_cast<const char *>(nl) - data : size;
+            QByteArray line = QByteArray::fromRawData(data + pos, int(qMin(end - pos, qint64(4096)))).trimmed();
+            if( ! line.isEmpty() && ! line.startsWith('#') ) {
+                if( urls == 0 )
+                    first = QByteArray(line.constData(), line.size());
+                ++urls;
+            }
+            pos = end + 1;
+
+            if( pos > nextCancelCheck ) {
+                if( cancel && cancel->load() )
+                    return {};
+                nextCancelCheck = pos + s_cancelCheckBytes;
+            }
+        }
+
+        Info info;
+        info.kind = tr("URI list");
+        info.charset = "US-ASCII";
+        info.details = tr("%n URL(s)", urls);
+        if( urls > 0 )
+            info.details += ", " + elide(QString::fromUtf8(first), 60);
+        return info;
+    }
+};
+
+
+class HtmlDecoder : public PayloadDecoder
+{
+public:
+    bool accepts(const QString &mime) const override
+    {
+        return mime.startsWith("text/html");
+    }
+
+    // The charset and title come from the start of the document, like the
+    // prescan of browsers; the rest is never read.
+    Info decode(const QString &mime, const Payload &payload, const QAtomicInt *) const override
+    {
+        const uchar *data = payloadData(payload);
+        const qint64 size = payload.size();
+
+        int bomLength;
+        QString charset = bomCharset(data, size, &bomLength);
+        if( charset.isEmpty() )
+            charset = mimeCharset(mime);
+        if( charset.isEmpty() )
+            charset = guessUtf16(data, size);
+        if( charset.isEmpty() ) {
+            static const QRegularExpression meta("<meta[^>]+charset\\s*=\\s*[\"']?([\\w-]+)",
+                                                 QRegularExpression::CaseInsensitiveOption);
+            const QByteArray head = QByteArray::fromRawData(payload.constData(), int(qMin(size, qint64(1024))));
+            charset = meta.match(QString::fromLatin1(head)).captured(1).toUpper();
+        }
+
+        QTextCodec *codec = QTextCodec::codecForName(charset.toLatin1());
+        if( ! codec ) {
+            codec = QTextCodec::codecForName("UTF-8");
+            charset = charset.isEmpty() ? tr("UTF-8 (assumed)") : tr("%1 (unknown)").arg(charset);
+        }
+
+        Info info;
+        info.kind = tr("HTML");
+        info.charset = charset;
+
+        const qint64 headSize = qMin(size - bomLength, s_prescanBytes);
+        const QString head = codec->toUnicode(reinterpret_cast<const char *>(data + bomLength), int(headSize));
+        static const QRegularExpression title("<title[^>]*>([^<]*)", QRegularExpression::CaseInsensitiveOption);
+        const QString documentTitle = title.match(head).captured(1);
+
+        info.details = tr("%n byte(s)", int(qMin(size, qint64(std::numeric_limits<int>::max()))));
+        if( ! documentTitle.trimmed().isEmpty() )
+            info.details += ", " + tr("title \"%1\"").arg(elide(documentTitle, 60));
+        return info;
+    }
+};
+
+
+// Also handles application/x-qt-image, which Qt serializes as PNG.
+class ImageDecoder : public PayloadDecoder
+{
+public:
+    bool accepts(const QString &mime) const override
+    {
+        return mime.startsWith("image/") || mime == "application/x-qt-image";
+    }
+
+    // QImageReader::size() only parses the header for all common formats.
+    Info decode(const QString &, const Payload &payload, const QAtomicInt *) const override
+    {
+        QByteArray data = QByteArray::fromRawData(payload.constData(),
+                                                  int(qMin(payload.size(), qint64(std::numeric_limits<int>::max()))));
+        QBuffer buffer(&data);
+        if( ! buffer.open(QIODevice::ReadOnly) )
+            return {};
+
+        QImageReader reader(&buffer);
+        reader.setDecideFormatFromContent(true);
+        const QByteArray format = reader.format();
+        if( format.isEmpty() ) {
+            Info info;
+            info.kind = tr("image");
+            info.details = reader.errorString();
+            return info;
+        }
+
+        Info info;
+        info.kind = tr("%1 image").arg(QString::fromLatin1(format.toUpper()));
+        const QSize size = reader.size();
+        if( size.isValid() )
+            info.details = tr("%1 x %2").arg(size.width()).arg(size.height());
+        else
+            info.details = reader.errorString();
+        return info;
+    }
+};
+
+
+// Plain text; tells UTF-16 from 8 bit text by BOM, MIME parameter or the
+// pattern of zero bytes at the start.
+class TextDecoder : public PayloadDecoder
+{
+public:
+    bool accepts(const QString &mime) const override
+    {
+        return mime.startsWith("text/") || mime == "UTF8_STRING" || mime == "STRING";
+    }
+
+    Info decode(const QString &mime, const Payload &payload, const QAtomicInt *) const override
+    {
+        const uchar *data = payloadData(payload);
+        const qint64 size = payload.size();
+
+        int bomLength;
+        QString charset = bomCharset(data, size, &bomLength);
+        if( charset.isEmpty() )
+            charset = mimeCharset(mime);
+        if( charset.isEmpty() || charset == "UTF-16" ) {
+            const QString guess = guessUtf16(data, size);
+            if( ! guess.isEmpty() )
+                charset = guess;
+            else if( ! charset.isEmpty() )
+                charset = "UTF-16LE";
+        }
+
+        Info info;
+        info.kind = tr("text");
+        if( charset.startsWith("UTF-16") ) {
+            info.charset = charset;
+            const qint64 units = (size - bomLength) / 2;
+            info.details = tr("%n UTF-16 code unit(s)", int(qMin(units, qint64(std::numeric_limits<int>::max()))));
+            if( (size - bomLength) % 2 )
+                info.details += ", " + tr("odd byte count");
+            return info;
+        }
+
+        if( ! charset.isEmpty() ) {
+            info.charset = charset;
+            return info;
+        }
+
+        // Judged by the start only.
+        const qint64 head = qMin(size, s_prescanBytes);
+        bool ascii = true;
+        for( qint64 i = 0; i < head && ascii; ++i )
+            ascii = data[i] < 0x80;
+        if( ascii ) {
+            info.charset = "US-ASCII";
+        } else {
+            QTextCodec::ConverterState state;
+            QTextCodec::codecForName("UTF-8")->toUnicode(reinterpret_cast<const char *>(data), int(head), &state);
+            // A sequence cut at the end of the prescan is not an error.
+            info.charset = state.invalidChars == 0 ? QString("UTF-8") : tr("8 bit, not UTF-8");
+        }
+        return info;
+    }
+};
+
+
+struct Registry
+{
+    Registry()
+    {
+        decoders << new TextDecoder << new ImageDecoder << new HtmlDecoder << new UriListDecoder;
+    }
+
+    ~Registry()
+    {
+        qDeleteAll(decoders);
+    }
+
+    const PayloadDecoder *find(const QString &mime)
+    {
+        QMutexLocker lock(&mutex);
+        for( int i = decoders.size() - 1; i >= 0; --i ) {
+            if( decoders.at(i)->accepts(mime) )
+                return decoders.at(i);
+        }
+        return nullptr;
+    }
+
+    QMutex mutex;
+    QList<PayloadDecoder *> decoders;
+};
+
+Q_GLOBAL_STATIC(Registry, registry)
+
+
+class DecodeJob : public QRunnable
+{
+public:
+    DecodeJob(PayloadDecoderPipeline *pipeline, const QSharedPointer<QAtomicInt> &cancel,
+              int id, const QString &mime, const Payload &payload)
+        : mPipeline(pipeline), mCancel(cancel), mId(id)
+        , mMime(mime), mPayload(payload)
+    {
+    }
+
+    void run() override
+    {
+        if( mCancel->load() )
+            return;
+
+        QElapsedTimer timer;
+        timer.start();
+        const PayloadDecoder::Info info = PayloadDecoder::run(mMime, mPayload, mCancel.data());
+        if( mCancel->load() )
+            return;
+
+        QMetaObject::invokeMethod(mPipeline, "deliver", Qt::QueuedConnection,
+                                  Q_ARG(int, mId), Q_ARG(PayloadDecoder::Info, info), Q_ARG(qint64, timer.nsecsElapsed()));
+    }
+
+private:
+    PayloadDecoderPipeline *mPipeline;
+    QSharedPointer<QAtomicInt> mCancel;
+    int mId;
+    QString mMime;
+    Payload mPayload;
+};
+
+}
+
+
+void PayloadDecoder::registerDecoder(PayloadDecoder *decoder)
+{
+    QMutexLocker lock(&registry->mutex);
+    registry->decoders.append(decoder);
+}
+
+bool PayloadDecoder::canDecode(const QString &mime)
+{
+    return registry->find(mime) != nullptr;
+}
+
+PayloadDecoder::Info PayloadDecoder::run(const QString &mime, const Payload &payload, const QAtomicInt *cancel)
+{
+    const PayloadDecoder *decoder = registry->find(mime);
+    if( ! decoder || payload.isNull() )
+        return {};
+
+    return decoder->decode(mime, payload, cancel);
+}
+
+
+
+PayloadDecoderPipeline::PayloadDecoderPipeline(QObject *parent)
+    : QObject(parent)
+{
+    qRegisterMetaType<PayloadDecoder::Info>();
+}
+
+PayloadDecoderPipeline::~PayloadDecoderPipeline()
+{
+    cancelAll();
+    mPool.waitForDone();
+}
+
+void PayloadDecoderPipeline::decode(int id, const QString &mime, const Payload &payload)
+{
+    QSharedPointer<QAtomicInt> cancel(new QAtomicInt(0));
+    mPending.insert(id, cancel);
+    mPool.start(new DecodeJob(this, cancel, id, mime, payload));
+}
+
+void PayloadDecoderPipeline::cancel(int id)
+{
+    const QSharedPointer<QAtomicInt> cancel = mPending.take(id);
+    if( cancel )
+        cancel->store(1);
+}
+
+void PayloadDecoderPipeline::cancelAll()
+{
+    mPool.clear();
+    for( const auto &cancel : mPending )
+        cancel->store(1);
+    mPending.clear();
+}
+
+void PayloadDecoderPipeline::deliver(int id, const PayloadDecoder::Info &info, qint64 nsecs)
+{
+    if( mPending.remove(id) )
+        emit decoded(id, info, nsecs);
+}
@@ -0,0 +1,90 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PAYLOADDECODER_H
+#define PAYLOADDECODER_H
+
+#include "payload.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QThreadPool>
+
+
+// Extracts format specific metadata from a payload, e.g. the dimensions of an
+// image. Decoders read only as much of the payload as they need, so the cost
+// of a decode does not grow with the payload size where the format allows.
+//
+// Decoders are looked up by MIME type in a process wide registry; the ones
+// registered last take precedence, built-in decoders are registered first.
+class PayloadDecoder
+{
+public:
+    struct Info {
+        // Short description of the content, empty if nothing was decoded.
+        QString kind;
+        QString charset;
+        QString details;
+
+        bool isNull() const { return kind.isEmpty(); }
+    };
+
+    virtual ~PayloadDecoder() {}
+
+    virtual bool accepts(const QString &mime) const = 0;
+    // Thread-safe; returns a null Info if the data is not what the decoder
+    // expected or if cancelled.
+    virtual Info decode(const QString &mime, const Payload &payload, const QAtomicInt *cancel) const = 0;
+
+    // Takes ownership.
+    static void registerDecoder(PayloadDecoder *decoder);
+    static bool canDecode(const QString &mime);
+    static Info run(const QString &mime, const Payload &payload, const QAtomicInt *cancel = 0);
+};
+
+Q_DECLARE_METATYPE(PayloadDecoder::Info)
+
+
+// Runs decoders on a thread pool, see PayloadHasher.
+class PayloadDecoderPipeline : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PayloadDecoderPipeline(QObject *parent = 0);
+    ~PayloadDecoderPipeline();
+
+    void decode(int id, const QString &mime, const Payload &payload);
+    void cancel(int id);
+    void cancelAll();
+
+signals:
+    void decoded(int id, const PayloadDecoder::Info &info, qint64 nsecs);
+
+private slots:
+    void deliver(int id, const PayloadDecoder::Info &info, qint64 nsecs);
+
+private:
+    QThreadPool mPool;
+    QHash<int, QSharedPointer<QAtomicInt>> mPending;
+};
+
+#endif // PAYLOADDECODER_H
@@ -0,0 +1,557 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadexporter.h"
+
+#include "config.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QSaveFile>
+
+#include <cstring>
+#include <functional>
+
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE)
+#include <cerrno>
+#include <unistd.h>
+#endif
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+
+static const qint64 s_chunkSize = 1024 * 1024;
+// Interval between progress reports.
+static const qint64 s_progressNsecs = 50 * 1000 * 1000;
+static const int s_tarBlockSize = 512;
+static const char s_manifestName[] = "manifest.json";
+
+static QString tr(const char *text)
+{
+    return QCoreApplication::translate("PayloadExporter", text);
+}
+
+// Copies as much as possible without touching the data in user space and
+// returns the number of bytes copied; stops silently e.g. on file systems
+// that do not support it.
+static qint64 kernelCopy(int outFd, const Payload &payload, const QAtomicInt &cancel,
+                         const std::function<void(qint64)> &advance)
+{
+    qint64 written = 0;
+
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_SENDFILE)
+    QFile in(payload.fileName());
+    if( ! in.open(QIODevice::ReadOnly) )
+        return 0;
+
+    const int inFd = in.handle();
+    const qint64 total = payload.size();
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while( written < total && ! cancel.load() ) {
+        loff_t inOffset = payload.fileOffset() + written;
+        const ssize_t copied = ::copy_file_range(inFd, &inOffset, outFd, nullptr,
+                                                 size_t(qMin(s_chunkSize, total - written)), 0);
+        if( copied <= 0 ) {
+            if( copied < 0 && errno == EINTR )
+                continue;
+            break;
+        }
+        written += copied;
+        advance(copied);
+    }
+#endif
+
+#ifdef HAVE_SENDFILE
+    while( written < total && ! cancel.load() ) {
+        off_t inOffset = payload.fileOffset() + written;
+        const ssize_t copied = ::sendfile(outFd, inFd, &inOffset, size_t(qMin(s_chunkSize, total - written)));
+        if( copied <= 0 ) {
+            if( copied < 0 && errno == EINTR )
+                continue;
+            break;
+        }
+        written += copied;
+        advance(copied);
+    }
+#endif
+#else
+    Q_UNUSED(outFd);
+    Q_UNUSED(payload);
+    Q_UNUSED(cancel);
+    Q_UNUSED(advance);
+#endif
+
+    return written;
+}
+
+// Writes the payload at the current position of the unbuffered file. Returns
+// false on errors; stops early without error when canceled.
+static bool copyPayload(QFileDevice &out, const Payload &payload, const QAtomicInt &cancel,
+                        const std::function<void(qint64)> &advance)
+{
+    const qint64 start = out.pos();
+    const qint64 total = payload.size();
+    qint64 written = 0;
+
+    if( ! payload.fileName().isEmpty() ) {
+        written = kernelCopy(out.handle(), payload, cancel, advance);
+        // Continue where the kernel stopped, if it did not get through.
+        if( written > 0 && ! out.seek(start + written) )
+            return false;
+    }
+
+    const char *data = payload.constData();
+    while( written < total && ! cancel.load() ) {
+        const qint64 n = out.write(data + written, qMin(s_chunkSize, total - written));
+        if( n <= 0 )
+            return false;
+        written += n;
+        advance(n);
+    }
+
+    return true;
+}
+
+static QString xxh64(const Payload &payload)
+{
+    // The content key starts with the XXH64 digest.
+    return QString::fromLatin1(payload.contentKey().left(8).toHex());
+}
+
+static void writeOctal(char *field, int len, qint64 value)
+{
+    for( int i = len - 2; i >= 0; --i ) {
+        field[i] = char('0' + (value & 7));
+        value >>= 3;
+    }
+    field[len - 1] = '\0';
+}
+
+// POSIX ustar header; sizes beyond the octal range use the GNU base-256
+// encoding understood by all common tar implementations.
+static QByteArray tarHeader(const QString &name, qint64 size, qint64 mtime)
+{
+    QByteArray h(s_tarBlockSize, '\0');
+    char *d = h.data();
+
+    const QByteArray n = name.toUtf8();
+    std::memcpy(d, n.constData(), size_t(qMin(n.size(), 99)));
+    writeOctal(d + 100, 8, 0644);
+    writeOctal(d + 108, 8, 0);
+    writeOctal(d + 116, 8, 0);
+    if( size < (Q_INT64_C(1) << 33) ) {
+        writeOctal(d + 124, 12, size);
+    } else {
+        d[124] = char(0x80);
+        for( int i = 135; i > 124; --i, size >>= 8 )
+            d[i] = char(size & 0xff);
+    }
+    writeOctal(d + 136, 12, mtime);
+    d[156] = '0';
+    std::memcpy(d + 257, "ustar", 6);
+    std::memcpy(d + 263, "00", 2);
+
+    std::memset(d + 148, ' ', 8);
+    unsigned int sum = 0;
+    for( int i = 0; i < s_tarBlockSize; ++i )
+        sum += uchar(d[i]);
+    writeOctal(d + 148, 7, sum);
+
+    return h;
+}
+
+namespace {
+
+// Shared by all jobs of one export.
+class ExportState
+{
+public:
+    ExportState(PayloadExporter *exporter, int id, const QSharedPointer<QAtomicInt> &cancel, qint64 total)
+        : mExporter(exporter), mId(id), mCancel(cancel), mTotal(total), mWritten(0), mLastProgress(0)
+    {
+        mTimer.start();
+    }
+
+    const QAtomicInt &cancelFlag() const { return *mCancel; }
+    bool isCanceled() const { return mCancel->load(); }
+    void cancel() { mCancel->store(1); }
+
+    std::function<void(qint64)> advance()
+    {
+        return [this](qint64 bytes) { advanceBy(bytes); };
+    }
+
+    void finish(const QString &errorString)
+    {
+        QMetaObject::invokeMethod(mExporter, "deliverFinished", Qt::QueuedConnection,
+                                  Q_ARG(int, mId), Q_ARG(QString, errorString),
+                                  Q_ARG(qint64, mTimer.nsecsElapsed()));
+    }
+
+private:
+    void advanceBy(qint64 bytes)
+    {
+        const qint64 written = mWritten.fetchAndAddRelaxed(bytes) + bytes;
+        const qint64 now = mTimer.nsecsElapsed();
+        const qint64 last = mLastProgress.load();
+        if( (now - last < s_progressNsecs && written < mTotal) || ! mLastProgress.testAndSetRelaxed(last, now) )
+            return;
+
+        QMetaObject::invokeMethod(mExporter, "deliverProgress", Qt::QueuedConnection,
+                                  Q_ARG(int, mId), Q_ARG(qint64, written), Q_ARG(qint64, mTotal));
+    }
+
+    PayloadExporter *mExporter;
+    int mId;
+    QSharedPointer<QAtomicInt> mCancel;
+    qint64 mTotal;
+    QAtomicInteger<qint64> mWritten;
+    QAtomicInteger<qint64> mLastProgress;
+    QElapsedTimer mTimer;
+};
+
+class SaveJob : public QRunnable
+{
+public:
+    SaveJob(const QSharedPointer<ExportState> &state, const Payload &payload, const QString &fileName)
+        : mState(state), mPayload(payload), mFileName(fileName)
+    {
+    }
+
+    void run() override
+    {
+        QSaveFile out(mFileName);
+        if( ! out.open(QIODevice::WriteOnly | QIODevice::Unbuffered) ) {
+            mState->finish(tr("cannot open %1: %2").arg(mFileName, out.errorString()));
+            return;
+        }
+
+        if( ! copyPayload(out, mPayload, mState->cancelFlag(), mState->advance()) ) {
+            out.cancelWriting();
+            mState->finish(tr("cannot write %1: %2").arg(mFileName, out.errorString()));
+            return;
+        }
+
+        if( mState->isCanceled() ) {
+            out.cancelWriting();
+            return;
+        }
+
+        if( ! out.commit() ) {
+            mState->finish(tr("cannot write %1: %2").arg(mFileName, out.errorString()));
+            return;
+        }
+
+        mState->finish(QString());
+    }
+
+private:
+    QSharedPointer<ExportState> mState;
+    Payload mPayload;
+    QString mFileName;
+};
+
+// Files and manifest of a batch export.
+struct Batch
+{
+    QVector<PayloadExporter::File> files;
+    QVector<QJsonObject> entries;
+    QJsonObject info;
+    QString path;
+
+    QMutex mutex;
+    QString errorString;
+    QAtomicInt pending;
+
+    Batch(const QVector<PayloadExporter::File> &files, const QJsonObject &info, const QString &path)
+        : files(files), info(info), path(path)
+    {
+        for( const auto &f : files ) {
+            QJsonObject e = f.info;
+            if( f.payload.isNull() ) {
+                e["available"] = false;
+            } else {
+                e["file"] = f.name;
+                e["size"] = double(f.payload.size());
+            }
+            entries.append(e);
+        }
+    }
+
+    QByteArray manifest() const
+    {
+        QJsonObject o = info;
+        QJsonArray a;
+        for( const auto &e : entries )
+            a.append(e);
+        o["files"] = a;
+        return QJsonDocument(o).toJson();
+    }
+};
+
+// Writes one file of a batch into a directory; the last job to finish
+// writes the manifest and reports the result.
+class DirectoryJob : public QRunnable
+{
+public:
+    DirectoryJob(const QSharedPointer<ExportState> &state, const QSharedPointer<Batch> &batch, int index)
+        : mState(state), mBatch(batch), mIndex(index)
+    {
+    }
+
+    void run() override
+    {
+        if( mIndex >= 0 && ! mState->isCanceled() ) {
+            const PayloadExporter::File &f = mBatch->files.at(mIndex);
+            const QString error = write(QDir(mBatch->path).filePath(f.name), f.payload);
+            if( ! error.isEmpty() ) {
+                fail(error);
+            } else if( ! mState->isCanceled() ) {
+                const QString digest = xxh64(f.payload);
+                QMutexLocker lock(&mBatch->mutex);
+                mBatch->entries[mIndex]["xxh64"] = digest;
+            }
+        }
+
+        if( mBatch->pending.deref() )
+            return;
+
+        if( mState->isCanceled() && mBatch->errorString.isEmpty() )
+            return;
+
+        if( mBatch->errorString.isEmpty() ) {
+            const QString error = write(QDir(mBatch->path).filePath(s_manifestName),
+                                        Payload::fromByteArray(mBatch->manifest()));
+            if( ! error.isEmpty() )
+                mBatch->errorString = error;
+        }
+
+        mState->finish(mBatch->errorString);
+    }
+
+private:
+    QString write(const QString &fileName, const Payload &payload)
+    {
+        QSaveFile out(fileName);
+        if( ! out.open(QIODevice::WriteOnly | QIODevice::Unbuffered) )
+            return tr("cannot open %1: %2").arg(fileName, out.errorString());
+
+        if( ! copyPayload(out, payload, mState->cancelFlag(), mState->advance()) ) {
+            out.cancelWriting();
+            return tr("cannot write %1: %2").arg(fileName, out.errorString());
+        }
+
+        if( mState->isCanceled() ) {
+            out.cancelWriting();
+            return QString();
+        }
+
+        if( ! out.commit() )
+            return tr("cannot write %1: %2").arg(fileName, out.errorString());
+
+        return QString();
+    }
+
+    void fail(const QString &errorString)
+    {
+        QMutexLocker lock(&mBatch->mutex);
+        if( mBatch->errorString.isEmpty() )
+            mBatch->errorString = errorString;
+        // Stop the other files of the batch.
+        mState->cancel();
+    }
+
+    QSharedPointer<ExportState> mState;
+    QSharedPointer<Batch> mBatch;
+    int mIndex;
+};
+
+// Streams all files of a batch into one tar archive, manifest last.
+class TarJob : public QRunnable
+{
+public:
+    TarJob(const QSharedPointer<ExportState> &state, const QSharedPointer<Batch> &batch)
+        : mState(state), mBatch(batch)
+    {
+    }
+
+    void run() override
+    {
+        QSaveFile out(mBatch->path);
+        if( ! out.open(QIODevice::WriteOnly | QIODevice::Unbuffered) ) {
+            mState->finish(tr("cannot open %1: %2").arg(mBatch->path, out.errorString()));
+            return;
+        }
+
+        const qint64 mtime = QDateTime::currentMSecsSinceEpoch() / 1000;
+        for( int i = 0; i < mBatch->files.size() && ! mState->isCanceled(); ++i ) {
+            const PayloadExporter::File &f = mBatch->files.at(i);
+            if( f.payload.isNull() )
+                continue;
+
+            if( ! writeEntry(out, f.name, f.payload, mtime) ) {
+                out.cancelWriting();
+                mState->finish(tr("cannot write %1: %2").arg(mBatch->path, out.errorString()));
+                return;
+            }
+            mBatch->entries[i]["xxh64"] = xxh64(f.payload);
+        }
+
+        if( ! mState->isCanceled() ) {
+            const QByteArray end(2 * s_tarBlockSize, '\0');
+            if( ! writeEntry(out, s_manifestName, Payload::fromByteArray(mBatch->manifest()), mtime)
+                    || out.write(end) != end.size() ) {
+                out.cancelWriting();
+                mState->finish(tr("cannot write %1: %2").arg(mBatch->path, out.errorString()));
+                return;
+            }
+        }
+
+        if( mState->isCanceled() ) {
+            out.cancelWriting();
+            return;
+        }
+
+        if( ! out.commit() ) {
+            mState->finish(tr("cannot write %1: %2").arg(mBatch->path, out.errorString()));
+            return;
+        }
+
+        mState->finish(QString());
+    }
+
+private:
+    bool writeEntry(QFileDevice &out, const QString &name, const Payload &payload, qint64 mtime)
+    {
+        const QByteArray header = tarHeader(name, payload.size(), mtime);
+        if( out.write(header) != header.size() )
+            return false;
+
+        if( ! copyPayload(out, payload, mState->cancelFlag(), mState->advance()) )
+            return false;
+
+        const int padding = int((s_tarBlockSize - payload.size() % s_tarBlockSize) % s_tarBlockSize);
+        return out.write(QByteArray(padding, '\0')) == padding;
+    }
+
+    QSharedPointer<ExportState> mState;
+    QSharedPointer<Batch> mBatch;
+};
+
+}
+
+
+PayloadExporter::PayloadExporter(QObject *parent)
+    : QObject(parent)
+    , mNextId(0)
+{
+    // Exports are mostly bound by the disk, but a few threads keep small
+    // exports from queueing behind a huge one and let batches of small
+    // formats overlap.
+    mPool.setMaxThreadCount(4);
+}
+
+PayloadExporter::~PayloadExporter()
+{
+    cancelAll();
+    mPool.waitForDone();
+}
+
+int PayloadExporter::save(const Payload &payload, const QString &fileName)
+{
+    int id;
+    const QSharedPointer<QAtomicInt> cancel = newExport(&id);
+    QSharedPointer<ExportState> state(new ExportState(this, id, cancel, payload.size()));
+    mPool.start(new SaveJob(state, payload, fileName));
+    return id;
+}
+
+int PayloadExporter::saveAll(const QVector<File> &files, const QJsonObject &info,
+                             BatchTarget target, const QString &path)
+{
+    int id;
+    const QSharedPointer<QAtomicInt> cancel = newExport(&id);
+
+    qint64 total = 0;
+    QVector<int> available;
+    for( int i = 0; i < files.size(); ++i ) {
+        total += files.at(i).payload.size();
+        if( ! files.at(i).payload.isNull() )
+            available.append(i);
+    }
+
+    QSharedPointer<ExportState> state(new ExportState(this, id, cancel, total));
+    QSharedPointer<Batch> batch(new Batch(files, info, path));
+
+    if( target == TarArchive ) {
+        mPool.start(new TarJob(state, batch));
+        return id;
+    }
+
+    // A batch without data still gets its manifest.
+    if( available.isEmpty() )
+        available.append(-1);
+    batch->pending.store(available.size());
+    for( int index : available )
+        mPool.start(new DirectoryJob(state, batch, index));
+
+    return id;
+}
+
+void PayloadExporter::cancel(int id)
+{
+    const auto cancel = mCancel.take(id);
+    if( cancel )
+        cancel->store(1);
+}
+
+void PayloadExporter::cancelAll()
+{
+    for( const auto &cancel : mCancel )
+        cancel->store(1);
+    mCancel.clear();
+}
+
+QSharedPointer<QAtomicInt> PayloadExporter::newExport(int *id)
+{
+    *id = ++mNextId;
+    QSharedPointer<QAtomicInt> cancel(new QAtomicInt(0));
+    mCancel.insert(*id, cancel);
+    return cancel;
+}
+
+void PayloadExporter::deliverProgress(int id, qint64 written, qint64 total)
+{
+    if( mCancel.contains(id) )
+        emit progress(id, written, total);
+}
+
+void PayloadExporter::deliverFinished(int id, const QString &errorString, qint64 nsecs)
+{
+    if( mCancel.remove(id) )
+        emit finished(id, errorString, nsecs);
+}
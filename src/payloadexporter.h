@@ -0,0 +1,84 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADEXPORTER_H
+#define PAYLOADEXPORTER_H
+
+#include "payload.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QJsonObject>
+#include <QObject>
+#include <QThreadPool>
+#include <QVector>
+
+
+// Writes payloads to files on worker threads, chunk by chunk straight from
+// the payload storage. Data of payloads that are mapped from a file is copied
+// by the kernel where the platform allows it. Progress and results are
+// delivered in the thread the exporter lives in; target files are only
+// replaced once they are completely written.
+class PayloadExporter : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct File {
+        QString name;
+        Payload payload;
+        // Extra manifest fields, e.g. the MIME type.
+        QJsonObject info;
+    };
+
+    enum BatchTarget {
+        Directory,
+        TarArchive
+    };
+
+    explicit PayloadExporter(QObject *parent = 0);
+    ~PayloadExporter();
+
+    // Returns an id to identify the export in signals and for cancel().
+    int save(const Payload &payload, const QString &fileName);
+    // Writes all files plus a manifest.json with their name, size, XXH64
+    // digest and info, and the given batch info. Directories are written in
+    // parallel, tar archives are streamed. Null payloads are only listed.
+    int saveAll(const QVector<File> &files, const QJsonObject &info,
+                BatchTarget target, const QString &path);
+    void cancel(int id);
+    void cancelAll();
+
+signals:
+    void progress(int id, qint64 written, qint64 total);
+    // errorString is empty on success; canceled exports report nothing.
+    void finished(int id, const QString &errorString, qint64 nsecs);
+
+private slots:
+    void deliverProgress(int id, qint64 written, qint64 total);
+    void deliverFinished(int id, const QString &errorString, qint64 nsecs);
+
+private:
+    QSharedPointer<QAtomicInt> newExport(int *id);
+
+    QThreadPool mPool;
+    QHash<int, QSharedPointer<QAtomicInt>> mCancel;
+    int mNextId;
+};
+
+#endif // PAYLOADEXPORTER_H
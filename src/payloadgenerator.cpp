@@ -0,0 +1,293 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadgenerator.h"
+
+#include <QtEndian>
+
+#include <cstring>
+#include <limits>
+
+static const qint64 s_chunkSize = 1024 * 1024;
+static const qint64 s_maxSize = 1024 * 1024 * 1024;
+static const int s_bmpHeaderSize = 54;
+
+static const QString s_specKind = "kind";
+static const QString s_specSize = "size";
+static const QString s_specSeed = "seed";
+static const QString s_specPattern = "pattern";
+static const QString s_specCount = "count";
+static const QString s_specWidth = "width";
+static const QString s_specHeight = "height";
+
+static qint64 bmpRowStride(int width)
+{
+    return (qint64(width) * 3 + 3) & ~qint64(3);
+}
+
+// Total number of decimal digits of 0 .. count - 1.
+static qint64 digitCount(qint64 count)
+{
+    qint64 digits = 0;
+    for( qint64 low = 0, high = 10, d = 1; low < count; low = high, high *= 10, ++d )
+        digits += (qMin(high, count) - low) * d;
+    return digits;
+}
+
+static void putLe16(char *p, quint16 v)
+{
+    qToLittleEndian(v, reinterpret_cast<uchar *>(p));
+}
+
+static void putLe32(char *p, quint32 v)
+{
+    qToLittleEndian(v, reinterpret_cast<uchar *>(p));
+}
+
+
+PayloadGenerator::PayloadGenerator(const QVariantMap &spec)
+    : mSpec(spec)
+    , mKind(RandomBytes)
+    , mKindValid(false)
+    , mSize(spec.value(s_specSize).toLongLong())
+    , mSeed(spec.value(s_specSeed).toUInt())
+    , mPattern(spec.value(s_specPattern).toByteArray())
+    , mCount(spec.value(s_specCount).toInt())
+    , mWidth(spec.value(s_specWidth).toInt())
+    , mHeight(spec.value(s_specHeight).toInt())
+{
+    const int kind = kindNames().indexOf(spec.value(s_specKind).toString());
+    if( kind >= 0 ) {
+        mKind = Kind(kind);
+        mKindValid = true;
+    }
+
+    switch( mKind ) {
+    case UriList:
+        // Lines only differ in the digits of their index.
+        mSize = qint64(mCount) * (uriListLine(0).size() - 1) + digitCount(mCount);
+        break;
+    case Image:
+        // Oversized images are rejected before the size could overflow.
+        if( mWidth > 0 && mHeight > 0 && bmpRowStride(mWidth) <= s_maxSize / mHeight )
+            mSize = s_bmpHeaderSize + bmpRowStride(mWidth) * mHeight;
+        else
+            mSize = s_maxSize + 1;
+        break;
+    default:
+        break;
+    }
+}
+
+QVariantMap PayloadGenerator::spec(Kind kind, qint64 size, quint32 seed, const QByteArray &pattern,
+                                   int count, int width, int height)
+{
+    QVariantMap s;
+    s[s_specKind] = kindNames().value(kind);
+    s[s_specSize] = size;
+    s[s_specSeed] = seed;
+    s[s_specPattern] = pattern;
+    s[s_specCount] = count;
+    s[s_specWidth] = width;
+    s[s_specHeight] = height;
+    return s;
+}
+
+bool PayloadGenerator::isValid() const
+{
+    if( ! mKindValid || mSize > s_maxSize )
+        return false;
+
+    switch( mKind ) {
+    case RandomBytes:
+        return mSize >= 0;
+    case Pattern:
+        return mSize >= 0 && ! mPattern.isEmpty();
+    case UriList:
+        return mCount >= 0;
+    case Image:
+        return mWidth > 0 && mHeight > 0;
+    }
+    return false;
+}
+
+bool PayloadGenerator::isAvailable() const
+{
+    return isValid();
+}
+
+qint64 PayloadGenerator::sizeHint() const
+{
+    return mSize;
+}
+
+Payload PayloadGenerator::fetch(const QString &)
+{
+    if( ! isValid() )
+        return Payload();
+
+    Payload::Writer writer(mSize);
+    switch( mKind ) {
+    case RandomBytes:
+        generateRandom(writer);
+        break;
+    case Pattern:
+        generatePattern(writer);
+        break;
+    case UriList:
+        generateUriList(writer);
+        break;
+    case Image:
+        generateImage(writer);
+        break;
+    }
+
+    return writer.finish();
+}
+
+bool PayloadGenerator::isCacheable() const
+{
+    return false;
+}
+
+QVariantMap PayloadGenerator::generatorSpec() const
+{
+    return mSpec;
+}
+
+qint64 PayloadGenerator::maxSize()
+{
+    return s_maxSize;
+}
+
+QStringList PayloadGenerator::kindNames()
+{
+    return QStringList() << "random" << "pattern" << "urilist" << "image";
+}
+
+QString PayloadGenerator::defaultMime(Kind kind)
+{
+    switch( kind ) {
+    case RandomBytes: return QStringLiteral("application/octet-stream");
+    case Pattern: return QStringLiteral("text/plain");
+    case UriList: return QStringLiteral("text/uri-list");
+    case Image: return QStringLiteral("image/bmp");
+    }
+    return {};
+}
+
+qint64 PayloadGenerator::parseSize(const QString &size)
+{
+    QString s = size.trimmed().toUpper();
+    qint64 factor = 1;
+    if( s.endsWith('K') )
+        factor = 1024;
+    else if( s.endsWith('M') )
+        factor = 1024 * 1024;
+    else if( s.endsWith('G') )
+        factor = 1024 * 1024 * 1024;
+    if( factor > 1 )
+        s.chop(1);
+
+    bool ok;
+    const qint64 n = s.toLongLong(&ok);
+    if( ! ok || n < 0 || n > std::numeric_limits<qint64>::max() / factor )
+        return -1;
+    return n * factor;
+}
+
+void PayloadGenerator::generateRandom(Payload::Writer &writer) const
+{
+    // xorshift64*, plenty for filler data and much faster than qrand()
+    quint64 state = (quint64(mSeed) << 32) ^ 0x9e3779b97f4a7c15ULL;
+    QByteArray chunk(int(qMin(s_chunkSize, mSize)), Qt::Uninitialized);
+
+    for( qint64 pos = 0; pos < mSize; pos += chunk.size() ) {
+        const int n = int(qMin(qint64(chunk.size()), mSize - pos));
+        for( int i = 0; i < n; i += 8 ) {
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            const quint64 v = state * 2685821657736338717ULL;
+            std::memcpy(chunk.data() + i, &v, size_t(qMin(8, n - i)));
+        }
+        writer.append(chunk.constData(), n);
+    }
+}
+
+void PayloadGenerator::generatePattern(Payload::Writer &writer) const
+{
+    // A whole number of repetitions, so consecutive chunks continue the pattern.
+    const int repetitions = int(qMax(qint64(1), s_chunkSize / mPattern.size()));
+    const QByteArray chunk = mPattern.repeated(repetitions);
+
+    for( qint64 pos = 0; pos < mSize; pos += chunk.size() )
+        writer.append(chunk.constData(), qMin(qint64(chunk.size()), mSize - pos));
+}
+
+void PayloadGenerator::generateUriList(Payload::Writer &writer) const
+{
+    QByteArray buffer;
+    buffer.reserve(int(s_chunkSize) + 256);
+
+    for( int i = 0; i < mCount; ++i ) {
+        buffer.append(uriListLine(i));
+        if( buffer.size() >= s_chunkSize ) {
+            writer.append(buffer);
+            buffer.resize(0);
+        }
+    }
+    writer.append(buffer);
+}
+
+void PayloadGenerator::generateImage(Payload::Writer &writer) const
+{
+    const qint64 stride = bmpRowStride(mWidth);
+
+    char header[s_bmpHeaderSize];
+    std::memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    putLe32(header + 2, quint32(mSize));
+    putLe32(header + 10, s_bmpHeaderSize);
+    putLe32(header + 14, 40);
+    putLe32(header + 18, quint32(mWidth));
+    putLe32(header + 22, quint32(mHeight));
+    putLe16(header + 26, 1);
+    putLe16(header + 28, 24);
+    putLe32(header + 34, quint32(stride * mHeight));
+    putLe32(header + 38, 2835);
+    putLe32(header + 42, 2835);
+    writer.append(header, sizeof(header));
+
+    QByteArray row(int(stride), '\0');
+    for( int y = mHeight - 1; y >= 0; --y ) {
+        char *p = row.data();
+        for( int x = 0; x < mWidth; ++x ) {
+            *p++ = char(qint64(x) * 255 / mWidth);
+            *p++ = char(qint64(y) * 255 / mHeight);
+            *p++ = char((x ^ y ^ int(mSeed)) & 0xff);
+        }
+        writer.append(row);
+    }
+}
+
+QByteArray PayloadGenerator::uriListLine(int idx) const
+{
+    return QString("file:///tmp/DragonDropTest/%1/file-%2.txt\r\n").arg(mSeed).arg(idx).toLatin1();
+}
@@ -0,0 +1,84 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADGENERATOR_H
+#define PAYLOADGENERATOR_H
+
+#include "payload.h"
+
+#include <QStringList>
+
+
+// Procedural payload source for load testing drop targets. Data is produced
+// in chunks every time it is fetched and never cached, large results go to
+// a mapped spill file. Formats still reach a target as a QByteArray, so each
+// retrieval holds one transient heap copy; sizes are capped at maxSize().
+//
+// The generator is fully described by its spec, which is what gets stored
+// in drag source configs instead of the data.
+class PayloadGenerator : public PayloadSource
+{
+public:
+    enum Kind {
+        RandomBytes,
+        Pattern,
+        UriList,
+        Image
+    };
+
+    explicit PayloadGenerator(const QVariantMap &spec);
+
+    static QVariantMap spec(Kind kind, qint64 size, quint32 seed,
+                            const QByteArray &pattern = QByteArray(), int count = 0,
+                            int width = 0, int height = 0);
+
+    // Within maxSize() and the limits of the kind.
+    bool isValid() const;
+
+    bool isAvailable() const override;
+    qint64 sizeHint() const override;
+    Payload fetch(const QString &mime) override;
+    bool isCacheable() const override;
+    QVariantMap generatorSpec() const override;
+
+    static qint64 maxSize();
+    static QStringList kindNames();
+    static QString defaultMime(Kind kind);
+    // Accepts K, M and G suffixes; returns -1 on error.
+    static qint64 parseSize(const QString &size);
+
+private:
+    void generateRandom(Payload::Writer &writer) const;
+    void generatePattern(Payload::Writer &writer) const;
+    void generateUriList(Payload::Writer &writer) const;
+    void generateImage(Payload::Writer &writer) const;
+
+    QByteArray uriListLine(int idx) const;
+
+    QVariantMap mSpec;
+    Kind mKind;
+    bool mKindValid;
+    qint64 mSize;
+    quint32 mSeed;
+    QByteArray mPattern;
+    int mCount;
+    int mWidth;
+    int mHeight;
+};
+
+#endif // PAYLOADGENERATOR_H
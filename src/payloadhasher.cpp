@@ -0,0 +1,100 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadhasher.h"
+
+#include <QElapsedTimer>
+#include <QRunnable>
+
+namespace {
+
+class HashJob : public QRunnable
+{
+public:
+    HashJob(PayloadHasher *hasher, const QSharedPointer<QAtomicInt> &cancel,
+            int id, const Payload &payload, ChunkedHash::Algorithm algorithm)
+        : mHasher(hasher), mCancel(cancel), mId(id)
+        , mPayload(payload), mAlgorithm(algorithm)
+    {
+    }
+
+    void run() override
+    {
+        if( mCancel->load() )
+            return;
+
+        QElapsedTimer timer;
+        timer.start();
+        const QString digest = ChunkedHash::hexDigest(mAlgorithm, mPayload, mCancel.data());
+        if( mCancel->load() )
+            return;
+
+        QMetaObject::invokeMethod(mHasher, "deliver", Qt::QueuedConnection,
+                                  Q_ARG(int, mId), Q_ARG(QString, digest),
+                                  Q_ARG(qint64, timer.nsecsElapsed()));
+    }
+
+private:
+    PayloadHasher *mHasher;
+    QSharedPointer<QAtomicInt> mCancel;
+    int mId;
+    Payload mPayload;
+    ChunkedHash::Algorithm mAlgorithm;
+};
+
+}
+
+
+PayloadHasher::PayloadHasher(QObject *parent)
+    : QObject(parent)
+{
+}
+
+PayloadHasher::~PayloadHasher()
+{
+    cancelAll();
+    mPool.waitForDone();
+}
+
+void PayloadHasher::hash(int id, const Payload &payload, ChunkedHash::Algorithm algorithm)
+{
+    QSharedPointer<QAtomicInt> cancel(new QAtomicInt(0));
+    mPending.insert(id, cancel);
+    mPool.start(new HashJob(this, cancel, id, payload, algorithm));
+}
+
+void PayloadHasher::cancel(int id)
+{
+    const QSharedPointer<QAtomicInt> cancel = mPending.take(id);
+    if( cancel )
+        cancel->store(1);
+}
+
+void PayloadHasher::cancelAll()
+{
+    mPool.clear();
+    for( const auto &cancel : mPending )
+        cancel->store(1);
+    mPending.clear();
+}
+
+void PayloadHasher::deliver(int id, const QString &digest, qint64 nsecs)
+{
+    if( mPending.remove(id) )
+        emit hashed(id, digest, nsecs);
+}
@@ -0,0 +1,59 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADHASHER_H
+#define PAYLOADHASHER_H
+
+#include "chunkedhash.h"
+#include "payload.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QThreadPool>
+
+
+// Computes payload digests on a dedicated thread pool. Results are delivered
+// through hashed() in the thread the hasher lives in; results of cancelled
+// requests are dropped. Request ids must not be reused.
+class PayloadHasher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PayloadHasher(QObject *parent = 0);
+    ~PayloadHasher();
+
+    void hash(int id, const Payload &payload, ChunkedHash::Algorithm algorithm);
+    // A running job stops at its next cancellation check.
+    void cancel(int id);
+    void cancelAll();
+
+signals:
+    void hashed(int id, const QString &digest, qint64 nsecs);
+
+private slots:
+    void deliver(int id, const QString &digest, qint64 nsecs);
+
+private:
+    QThreadPool mPool;
+    // Cancel flag of each pending request.
+    QHash<int, QSharedPointer<QAtomicInt>> mPending;
+};
+
+#endif // PAYLOADHASHER_H
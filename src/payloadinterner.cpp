@@ -0,0 +1,114 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadinterner.h"
+
+#include "payloadstore.h"
+
+#include <QRunnable>
+
+
+// Payloads are taken on the calling thread; lazy entries must not be
+// touched from the pool.
+struct PayloadInterner::Batch
+{
+    DnDAction action;
+    QVector<Payload> payloads;
+    QAtomicInt cancel;
+};
+
+class PayloadInterner::Job : public QRunnable
+{
+public:
+    Job(PayloadInterner *interner, int id, const QSharedPointer<Batch> &batch)
+        : mInterner(interner), mId(id), mBatch(batch)
+    {
+    }
+
+    void run() override
+    {
+        for( auto &payload : mBatch->payloads ) {
+            if( mBatch->cancel.load() )
+                return;
+            payload = PayloadStore::instance().intern(payload);
+        }
+
+        QMetaObject::invokeMethod(mInterner, "deliver", Qt::QueuedConnection, Q_ARG(int, mId));
+    }
+
+private:
+    PayloadInterner *mInterner;
+    int mId;
+    QSharedPointer<Batch> mBatch;
+};
+
+
+PayloadInterner::PayloadInterner(QObject *parent)
+    : QObject(parent)
+{
+}
+
+PayloadInterner::~PayloadInterner()
+{
+    cancelAll();
+    mPool.waitForDone();
+}
+
+void PayloadInterner::intern(int id, const DnDAction &action)
+{
+    QSharedPointer<Batch> batch(new Batch);
+    batch->action = action;
+    batch->payloads.resize(action.data.size());
+    for( int i = 0; i < action.data.size(); ++i ) {
+        if( action.data.at(i).isFetched() )
+            batch->payloads[i] = action.data.at(i).payload();
+    }
+
+    mPending.insert(id, batch);
+    mPool.start(new Job(this, id, batch));
+}
+
+void PayloadInterner::cancel(int id)
+{
+    const QSharedPointer<Batch> batch = mPending.take(id);
+    if( batch )
+        batch->cancel.store(1);
+}
+
+void PayloadInterner::cancelAll()
+{
+    mPool.clear();
+    for( const auto &batch : mPending )
+        batch->cancel.store(1);
+    mPending.clear();
+}
+
+void PayloadInterner::deliver(int id)
+{
+    const QSharedPointer<Batch> batch = mPending.take(id);
+    if( ! batch )
+        return;
+
+    DnDAction action = batch->action;
+    for( int i = 0; i < action.data.size(); ++i ) {
+        const Payload &payload = batch->payloads.at(i);
+        if( ! payload.isNull() )
+            action.data[i] = DnDAction::DataEntry(action.data.at(i).mime(), payload);
+    }
+    emit interned(id, action);
+}
@@ -0,0 +1,60 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADINTERNER_H
+#define PAYLOADINTERNER_H
+
+#include "dndaction.h"
+
+#include <QAtomicInt>
+#include <QHash>
+#include <QObject>
+#include <QThreadPool>
+
+
+// Interns the fetched entries of a DnDAction in the PayloadStore on a thread
+// pool, so that neither hashing nor spilling large payloads blocks the GUI.
+// Entries that are not fetched are passed through; see PayloadHasher for
+// request ids and cancellation.
+class PayloadInterner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PayloadInterner(QObject *parent = 0);
+    ~PayloadInterner();
+
+    void intern(int id, const DnDAction &action);
+    void cancel(int id);
+    void cancelAll();
+
+signals:
+    void interned(int id, const DnDAction &action);
+
+private slots:
+    void deliver(int id);
+
+private:
+    struct Batch;
+    class Job;
+
+    QThreadPool mPool;
+    QHash<int, QSharedPointer<Batch>> mPending;
+};
+
+#endif // PAYLOADINTERNER_H
@@ -0,0 +1,103 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadmimedata.h"
+
+#include "memoryaccounting.h"
+
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+
+
+PayloadMimeData::PayloadMimeData(const QVector<DnDAction::DataEntry> &entries)
+    : mEntries(entries)
+    , mGenerationDelay(0)
+{
+    // Lazy entries count once a retrieval fetched them.
+    MemoryAccounting::instance().setProvider(this, tr("Mime data"), [this]() {
+        QVector<MemoryAccounting::Holding> holdings;
+        for( const auto &e : mEntries ) {
+            if( e.isFetched() )
+                holdings.append(MemoryAccounting::Holding::of(e.payload()));
+        }
+        return holdings;
+    });
+}
+
+PayloadMimeData::~PayloadMimeData()
+{
+    MemoryAccounting::instance().release(this);
+}
+
+const QVector<DnDAction::DataEntry> &PayloadMimeData::entries() const
+{
+    return mEntries;
+}
+
+int PayloadMimeData::generationDelay() const
+{
+    return mGenerationDelay;
+}
+
+void PayloadMimeData::setGenerationDelay(int msecs)
+{
+    mGenerationDelay = msecs;
+}
+
+QStringList PayloadMimeData::formats() const
+{
+    QStringList res;
+    res.reserve(mEntries.size());
+    for( const auto &e : mEntries )
+        res.append(e.mime());
+    return res;
+}
+
+bool PayloadMimeData::hasFormat(const QString &mimeType) const
+{
+    return indexOf(mimeType) >= 0;
+}
+
+QVariant PayloadMimeData::retrieveData(const QString &mimeType, QVariant::Type) const
+{
+    const int idx = indexOf(mimeType);
+    if( idx < 0 )
+        return QVariant();
+
+    QElapsedTimer timer;
+    timer.start();
+    if( mGenerationDelay > 0 )
+        QThread::msleep(ulong(mGenerationDelay));
+
+    // Callers may keep the array past this object and any mapping, so it
+    // has to own its bytes; heap payloads are still shared, not copied.
+    const QByteArray bytes = mEntries.at(idx).payload().toByteArray();
+    emit const_cast<PayloadMimeData *>(this)->formatRetrieved(mimeType, bytes.size(), timer.nsecsElapsed());
+
+    return bytes;
+}
+
+int PayloadMimeData::indexOf(const QString &mimeType) const
+{
+    for( int i = 0; i < mEntries.size(); ++i ) {
+        if( mEntries.at(i).mime() == mimeType )
+            return i;
+    }
+    return -1;
+}
@@ -0,0 +1,62 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADMIMEDATA_H
+#define PAYLOADMIMEDATA_H
+
+#include "dndaction.h"
+
+#include <QMimeData>
+#include <QVector>
+
+
+// Mime data that serves the entries of a DnDAction only when a format is
+// actually requested, so unrequested formats are never materialized. Heap
+// payloads are shared with the returned arrays; mapped ones are copied, as
+// the arrays may outlive the mapping.
+class PayloadMimeData : public QMimeData
+{
+    Q_OBJECT
+
+public:
+    explicit PayloadMimeData(const QVector<DnDAction::DataEntry> &entries);
+    ~PayloadMimeData();
+
+    const QVector<DnDAction::DataEntry> &entries() const;
+
+    // Simulated cost of producing a format, applied on every retrieval.
+    int generationDelay() const;
+    void setGenerationDelay(int msecs);
+
+    QStringList formats() const override;
+    bool hasFormat(const QString &mimeType) const override;
+
+signals:
+    void formatRetrieved(const QString &mimeType, qint64 bytes, qint64 nsecs);
+
+protected:
+    QVariant retrieveData(const QString &mimeType, QVariant::Type type) const override;
+
+private:
+    int indexOf(const QString &mimeType) const;
+
+    QVector<DnDAction::DataEntry> mEntries;
+    int mGenerationDelay;
+};
+
+#endif // PAYLOADMIMEDATA_H
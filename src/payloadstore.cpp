@@ -0,0 +1,119 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "payloadstore.h"
+
+#include <QMutexLocker>
+
+#include <cstring>
+
+
+PayloadStore &PayloadStore::instance()
+{
+    static PayloadStore store;
+    return store;
+}
+
+PayloadStore::PayloadStore()
+    : mPurgeSize(64)
+    , mDeduplicatedBytes(0)
+{
+}
+
+Payload PayloadStore::intern(const Payload &payload)
+{
+    if( payload.isNull() )
+        return payload;
+
+    const QByteArray key = payload.contentKey();
+
+    QMutexLocker lock(&mMutex);
+
+    for( auto it = mEntries.find(key); it != mEntries.end() && it.key() == key; ++it ) {
+        Payload existing;
+        existing.d = it.value().toStrongRef();
+        if( existing.isNull() )
+            continue;
+        if( existing.isSharedWith(payload) )
+            return payload;
+
+        // The key includes the size, a match is only a digest collision away
+        // from being equal.
+        if( std::memcmp(existing.constData(), payload.constData(), size_t(payload.size())) == 0 ) {
+            mDeduplicatedBytes += payload.size();
+            return existing;
+        }
+    }
+
+    // Only spill data that is not held yet, a duplicate never touches disk.
+    lock.unlock();
+    const Payload unique = payload.spilled();
+    lock.relock();
+
+    mEntries.insert(key, unique.d.toWeakRef());
+    if( mEntries.size() > mPurgeSize )
+        purge();
+
+    return unique;
+}
+
+int PayloadStore::count() const
+{
+    QMutexLocker lock(&mMutex);
+
+    int count = 0;
+    for( const auto &e : mEntries ) {
+        if( ! e.isNull() )
+            ++count;
+    }
+
+    return count;
+}
+
+qint64 PayloadStore::bytes() const
+{
+    QMutexLocker lock(&mMutex);
+
+    qint64 bytes = 0;
+    for( const auto &e : mEntries ) {
+        Payload p;
+        p.d = e.toStrongRef();
+        bytes += p.size();
+    }
+
+    return bytes;
+}
+
+qint64 PayloadStore::deduplicatedBytes() const
+{
+    QMutexLocker lock(&mMutex);
+    return mDeduplicatedBytes;
+}
+
+void PayloadStore::purge()
+{
+    for( auto it = mEntries.begin(); it != mEntries.end(); ) {
+        if( it.value().isNull() )
+            it = mEntries.erase(it);
+        else
+            ++it;
+    }
+
+    // Amortize the sweep over as many inserts as there are live entries.
+    mPurgeSize = qMax(64, mEntries.size() * 2);
+}
@@ -0,0 +1,58 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PAYLOADSTORE_H
+#define PAYLOADSTORE_H
+
+#include "payload.h"
+
+#include <QMultiHash>
+#include <QMutex>
+#include <QWeakPointer>
+
+
+// Process wide, content addressed index of live payloads. Interning returns
+// an existing payload with the same bytes if there is one, so data that
+// arrives repeatedly through drops, the clipboard or drag source configs is
+// held in memory once. Large payloads are spilled only after they turned out
+// to be new. Only weak references are kept; a payload leaves the store when
+// its last user drops it.
+class PayloadStore
+{
+public:
+    static PayloadStore &instance();
+
+    Payload intern(const Payload &payload);
+
+    int count() const;
+    qint64 bytes() const;
+    // Total size of all payloads that were replaced by an existing one.
+    qint64 deduplicatedBytes() const;
+
+private:
+    PayloadStore();
+
+    void purge();
+
+    mutable QMutex mMutex;
+    QMultiHash<QByteArray, QWeakPointer<const PayloadStorage>> mEntries;
+    int mPurgeSize;
+    qint64 mDeduplicatedBytes;
+};
+
+#endif // PAYLOADSTORE_H
@@ -0,0 +1,443 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "payloadview.h"
+
+#include "memoryaccounting.h"
+
+#include <QByteArrayMatcher>
+#include <QElapsedTimer>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QRunnable>
+#include <QScrollBar>
+#include <QSignalBlocker>
+
+static const int s_hexBytesPerRow = 16;
+static const int s_textBytesPerRow = 64;
+static const qint64 s_findChunk = 64 * 1024 * 1024;
+
+namespace {
+
+class FindJob : public QRunnable
+{
+public:
+    FindJob(PayloadView *view, const QSharedPointer<QAtomicInt> &cancel, int generation,
+            const Payload &payload, const QByteArray &needle, qint64 from)
+        : mView(view), mCancel(cancel), mGeneration(generation)
+        , mPayload(payload), mNeedle(needle), mMatcher(needle), mFrom(from)
+    {
+    }
+
+    void run() override
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        qint64 offset = find(mFrom, mPayload.size());
+        if( offset < 0 && mFrom > 0 )
+            offset = find(0, qMin(mFrom + mNeedle.size() - 1, mPayload.size()));
+        if( mCancel->load() )
+            return;
+
+        QMetaObject::invokeMethod(mView, "onFound", Qt::QueuedConnection,
+                                  Q_ARG(int, mGeneration), Q_ARG(qint64, offset),
+                                  Q_ARG(qint64, mNeedle.size()), Q_ARG(qint64, timer.nsecsElapsed()));
+    }
+
+private:
+    // Matches chunk by chunk, consecutive chunks overlap by the needle size
+    // minus one so that no match is missed.
+    qint64 find(qint64 begin, qint64 end) const
+    {
+        const char *data = mPayload.constData();
+        const qint64 chunk = qMax(s_findChunk, qint64(mNeedle.size()) * 2);
+        for( qint64 pos = begin; end - pos >= mNeedle.size(); pos += chunk - mNeedle.size() + 1 ) {
+            if( mCancel->load() )
+                return -1;
+
+            const qint64 len = qMin(chunk, end - pos);
+            const int i = mMatcher.indexIn(data + pos, int(len));
+            if( i >= 0 )
+                return pos + i;
+            if( pos + len >= end )
+                break;
+        }
+        return -1;
+    }
+
+    PayloadView *mView;
+    QSharedPointer<QAtomicInt> mCancel;
+    int mGeneration;
+    Payload mPayload;
+    QByteArray mNeedle;
+    QByteArrayMatcher mMatcher;
+    qint64 mFrom;
+};
+
+}
+
+
+PayloadView::PayloadView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , mMode(Hex)
+    , mCursor(-1)
+    , mMarkLength(0)
+    , mTopRow(0)
+    , mRowsPerStep(1)
+    , mCancel(new QAtomicInt(0))
+    , mGeneration(0)
+    , mSearching(false)
+{
+    mPool.setMaxThreadCount(1);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    viewport()->setCursor(Qt::IBeamCursor);
+    updateScrollBars();
+}
+
+PayloadView::~PayloadView()
+{
+    cancelFind();
+    mPool.waitForDone();
+    MemoryAccounting::instance().release(this);
+}
+
+Payload PayloadView::payload() const
+{
+    return mPayload;
+}
+
+PayloadView::Mode PayloadView::mode() const
+{
+    return mMode;
+}
+
+qint64 PayloadView::cursor() const
+{
+    return mCursor;
+}
+
+bool PayloadView::isSearching() const
+{
+    return mSearching;
+}
+
+void PayloadView::setPayload(const Payload &payload)
+{
+    if( payload.isSharedWith(mPayload) )
+        return;
+
+    cancelFind();
+    mPayload = payload;
+    MemoryAccounting::instance().setHoldings(this, tr("Payload view"), { MemoryAccounting::Holding::of(mPayload) });
+    mCursor = -1;
+    mMarkLength = 0;
+    mTopRow = 0;
+    updateScrollBars();
+    viewport()->update();
+    emit cursorChanged(-1);
+}
+
+void PayloadView::setMode(int mode)
+{
+    if( mode == mMode )
+        return;
+
+    mMode = Mode(mode);
+    updateScrollBars();
+    if( mCursor >= 0 )
+        scrollToOffset(mCursor);
+    viewport()->update();
+}
+
+void PayloadView::goToOffset(qint64 offset)
+{
+    if( mPayload.size() == 0 )
+        return;
+
+    offset = qBound(qint64(0), offset, mPayload.size() - 1);
+    mark(offset, 1);
+    scrollToOffset(offset);
+}
+
+void PayloadView::find(const QByteArray &needle)
+{
+    cancelFind();
+    if( needle.isEmpty() || mPayload.size() < needle.size() ) {
+        emit found(-1, 0);
+        return;
+    }
+
+    mSearching = true;
+    mPool.start(new FindJob(this, mCancel, mGeneration, mPayload, needle, mCursor + 1));
+}
+
+void PayloadView::cancelFind()
+{
+    mCancel->store(1);
+    mCancel.reset(new QAtomicInt(0));
+    ++mGeneration;
+    mSearching = false;
+}
+
+void PayloadView::onFound(int generation, qint64 offset, qint64 length, qint64 nsecs)
+{
+    if( generation != mGeneration )
+        return;
+
+    mSearching = false;
+    if( offset >= 0 ) {
+        mark(offset, length);
+        scrollToOffset(offset);
+    }
+    emit found(offset, nsecs);
+}
+
+void PayloadView::paintEvent(QPaintEvent *)
+{
+    QPainter p(viewport());
+    p.fillRect(viewport()->rect(), palette().color(QPalette::Base));
+    if( mPayload.size() == 0 )
+        return;
+
+    const QFontMetrics fm(font());
+    const int cw = fm.horizontalAdvance(QLatin1Char('0'));
+    const int lh = fm.height();
+    const int bpr = bytesPerRow();
+    const uchar *data = reinterpret_cast<const uchar *>(mPayload.constData());
+    const qint64 size = mPayload.size();
+    const int digits = offsetDigits();
+
+    QColor markColor = palette().color(QPalette::Highlight);
+    markColor.setAlpha(96);
+    const QColor offsetColor = palette().color(QPalette::Disabled, QPalette::Text);
+    const QColor textColor = palette().color(QPalette::Text);
+
+    p.translate(-horizontalScrollBar()->value(), 0);
+
+    for( int r = 0; r <= visibleRows(); ++r ) {
+        const qint64 row = mTopRow + r;
+        if( row >= rowCount() )
+            break;
+
+        const qint64 offset = row * bpr;
+        const int n = int(qMin(qint64(bpr), size - offset));
+        const int y = r * lh;
+
+        QString line;
+        qint64 textBegin = offset;
+        if( mMode == Hex ) {
+            static const char hexDigits[] = "0123456789abcdef";
+            const int base = hexColumn(0);
+            line.fill(QLatin1Char(' '), asciiColumn(n) - base);
+            for( int i = 0; i < n; ++i ) {
+                const uchar c = data[offset + i];
+                line[hexColumn(i) - base] = QLatin1Char(hexDigits[c >> 4]);
+                line[hexColumn(i) - base + 1] = QLatin1Char(hexDigits[c & 0xf]);
+                line[asciiColumn(i) - base] = c >= 0x20 && c < 0x7f ? QLatin1Char(c) : QLatin1Char('.');
+            }
+        } else {
+            line = textRow(offset, &textBegin);
+        }
+
+        const qint64 markBegin = qMax(mCursor, offset);
+        const qint64 markEnd = qMin(mCursor + qMax(mMarkLength, qint64(1)), offset + n);
+        if( mCursor >= 0 && markBegin < markEnd ) {
+            const int first = int(markBegin - offset);
+            const int last = int(markEnd - offset) - 1;
+            if( mMode == Hex ) {
+                p.fillRect(hexColumn(first) * cw, y, (hexColumn(last) + 2 - hexColumn(first)) * cw, lh, markColor);
+                p.fillRect(asciiColumn(first) * cw, y, (last + 1 - first) * cw, lh, markColor);
+            } else {
+                // Decoded characters may span several bytes, so the marked
+                // bytes are located in the text of the row.
+                const char *text = reinterpret_cast<const char *>(data + textBegin);
+                const qint64 from = qMax(markBegin, textBegin);
+                const int c0 = QString::fromUtf8(text, int(from - textBegin)).size();
+                const int c1 = QString::fromUtf8(text, int(qMax(markEnd, from) - textBegin)).size();
+                p.fillRect((digits + 2) * cw + fm.horizontalAdvance(line.left(c0)), y,
+                           fm.horizontalAdvance(line.mid(c0, c1 - c0)), lh, markColor);
+            }
+        }
+
+        p.setPen(offsetColor);
+        p.drawText(0, y + fm.ascent(), QString("%1").arg(offset, digits, 16, QLatin1Char('0')));
+
+        p.setPen(textColor);
+        p.drawText((digits + 2) * cw, y + fm.ascent(), line);
+    }
+}
+
+void PayloadView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void PayloadView::scrollContentsBy(int, int dy)
+{
+    if( dy != 0 )
+        mTopRow = qMin(qint64(verticalScrollBar()->value()) * mRowsPerStep, maxTopRow());
+    viewport()->update();
+}
+
+void PayloadView::mousePressEvent(QMouseEvent *event)
+{
+    const qint64 offset = offsetAt(event->pos());
+    if( offset >= 0 )
+        mark(offset, 1);
+}
+
+int PayloadView::bytesPerRow() const
+{
+    return mMode == Hex ? s_hexBytesPerRow : s_textBytesPerRow;
+}
+
+qint64 PayloadView::rowCount() const
+{
+    return (mPayload.size() + bytesPerRow() - 1) / bytesPerRow();
+}
+
+int PayloadView::visibleRows() const
+{
+    return qMax(1, viewport()->height() / QFontMetrics(font()).height());
+}
+
+qint64 PayloadView::maxTopRow() const
+{
+    return qMax(qint64(0), rowCount() - visibleRows());
+}
+
+int PayloadView::offsetDigits() const
+{
+    int digits = 8;
+    while( digits < 16 && (mPayload.size() >> (digits * 4)) > 0 )
+        ++digits;
+    return digits;
+}
+
+// Hex bytes are separated by a space, with an extra one after the eighth.
+int PayloadView::hexColumn(int byte) const
+{
+    return offsetDigits() + 2 + byte * 3 + (byte >= 8 ? 1 : 0);
+}
+
+int PayloadView::asciiColumn(int byte) const
+{
+    return hexColumn(s_hexBytesPerRow) + 1 + byte;
+}
+
+qint64 PayloadView::offsetAt(const QPoint &pos) const
+{
+    const QFontMetrics fm(font());
+    const int col = (pos.x() + horizontalScrollBar()->value()) / fm.horizontalAdvance(QLatin1Char('0'));
+    const qint64 row = mTopRow + pos.y() / fm.height();
+    if( row >= rowCount() )
+        return -1;
+
+    int byte = -1;
+    if( mMode == Hex ) {
+        const int hex = col - hexColumn(0);
+        const int ascii = col - asciiColumn(0);
+        if( ascii >= 0 )
+            byte = ascii;
+        else if( hex >= 0 )
+            byte = hex < 24 ? hex / 3 : (hex - 1) / 3;
+    } else {
+        // Only exact for ASCII text.
+        byte = col - offsetDigits() - 2;
+    }
+
+    const qint64 offset = row * bytesPerRow() + byte;
+    if( byte < 0 || byte >= bytesPerRow() || offset >= mPayload.size() )
+        return -1;
+    return offset;
+}
+
+void PayloadView::mark(qint64 offset, qint64 length)
+{
+    mCursor = offset;
+    mMarkLength = length;
+    viewport()->update();
+    emit cursorChanged(offset);
+}
+
+void PayloadView::scrollToOffset(qint64 offset)
+{
+    const qint64 row = offset / bytesPerRow();
+    if( row >= mTopRow && row < mTopRow + visibleRows() )
+        return;
+
+    mTopRow = qBound(qint64(0), row - visibleRows() / 2, maxTopRow());
+    const QSignalBlocker blocker(verticalScrollBar());
+    verticalScrollBar()->setValue(int(mTopRow / mRowsPerStep));
+    viewport()->update();
+}
+
+void PayloadView::updateScrollBars()
+{
+    const qint64 maxTop = maxTopRow();
+    mRowsPerStep = 1 + maxTop / (1 << 30);
+    mTopRow = qMin(mTopRow, maxTop);
+
+    const QSignalBlocker blocker(verticalScrollBar());
+    verticalScrollBar()->setRange(0, int((maxTop + mRowsPerStep - 1) / mRowsPerStep));
+    verticalScrollBar()->setPageStep(int(qMax(qint64(1), visibleRows() / mRowsPerStep)));
+    verticalScrollBar()->setValue(int(mTopRow / mRowsPerStep));
+
+    const int columns = mMode == Hex ? asciiColumn(s_hexBytesPerRow) : offsetDigits() + 2 + s_textBytesPerRow;
+    const int width = columns * QFontMetrics(font()).horizontalAdvance(QLatin1Char('0'));
+    horizontalScrollBar()->setRange(0, qMax(0, width - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+}
+
+// Decodes the row as UTF-8. Sequences that cross the end of the row are shown
+// on it, their continuation bytes are skipped on the next one; textBegin
+// receives the offset of the first byte shown.
+QString PayloadView::textRow(qint64 offset, qint64 *textBegin) const
+{
+    const uchar *data = reinterpret_cast<const uchar *>(mPayload.constData());
+    const qint64 size = mPayload.size();
+
+    qint64 begin = offset;
+    qint64 end = qMin(offset + s_textBytesPerRow, size);
+    if( offset > 0 ) {
+        while( begin < end && begin < offset + 3 && (data[begin] & 0xc0) == 0x80 )
+            ++begin;
+    }
+    for( qint64 i = qMax(begin, end - 3); i < end; ++i ) {
+        const uchar lead = data[i];
+        const int len = lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 1;
+        if( i + len > end ) {
+            end = qMin(i + len, size);
+            break;
+        }
+    }
+
+    QString text = QString::fromUtf8(reinterpret_cast<const char *>(data + begin), int(end - begin));
+    for( int i = 0; i < text.size(); ++i ) {
+        if( text.at(i).unicode() < 0x20 || text.at(i).unicode() == 0x7f )
+            text[i] = QLatin1Char('.');
+    }
+    if( textBegin )
+        *textBegin = begin;
+    return text;
+}
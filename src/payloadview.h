@@ -0,0 +1,104 @@
+/* Copyright 2014, 2015 Zeno Sebastian Endemann <zeno.endemann@googlemail.com>
+ *
+ * This file is part of DragonDropTest.
+ *
+ * DragonDropTest is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * DragonDropTest is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with DragonDropTest.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PAYLOADVIEW_H
+#define PAYLOADVIEW_H
+
+#include "payload.h"
+
+#include <QAbstractScrollArea>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+
+// Hex or UTF-8 text view of a payload. Only the visible rows are rendered,
+// straight from the payload's storage, so mapped payloads of any size are
+// paged in on demand. Searching runs on a worker thread and wraps around at
+// the end of the payload.
+class PayloadView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    enum Mode {
+        Hex,
+        Text
+    };
+
+    explicit PayloadView(QWidget *parent = 0);
+    ~PayloadView();
+
+    Payload payload() const;
+    Mode mode() const;
+    // Start of the marked bytes, -1 if none.
+    qint64 cursor() const;
+    bool isSearching() const;
+
+signals:
+    void cursorChanged(qint64 offset);
+    // offset is -1 if the bytes were not found.
+    void found(qint64 offset, qint64 nsecs);
+
+public slots:
+    void setPayload(const Payload &payload);
+    void setMode(int mode);
+    void goToOffset(qint64 offset);
+    // Searches from the byte after the cursor.
+    void find(const QByteArray &needle);
+    void cancelFind();
+
+protected:
+    void paintEvent(QPaintEvent *) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void mousePressEvent(QMouseEvent *event) override;
+
+private slots:
+    void onFound(int generation, qint64 offset, qint64 length, qint64 nsecs);
+
+private:
+    int bytesPerRow() const;
+    qint64 rowCount() const;
+    int visibleRows() const;
+    int offsetDigits() const;
+    int hexColumn(int byte) const;
+    int asciiColumn(int byte) const;
+    qint64 offsetAt(const QPoint &pos) const;
+
+    void mark(qint64 offset, qint64 length);
+    void scrollToOffset(qint64 offset);
+    qint64 maxTopRow() const;
+    void updateScrollBars();
+    QString textRow(qint64 offset, qint64 *textBegin = 0) const;
+
+    Payload mPayload;
+    Mode mMode;
+    qint64 mCursor;
+    qint64 mMarkLength;
+    qint64 mTopRow;
+    // Rows per scroll bar step, keeps the range within int for huge payloads.
+    qint64 mRowsPerStep;
+
+    QThreadPool mPool;
+    QSharedPointer<QAtomicInt> mCancel;
+    int mGeneration;
+    bool mSearching;
+};
+
+#endif // PAYLOADVIEW_H
@@ -20,23 +20,37 @@
 #include "ui_widget.h"
 
 #include "dragsource.h"
+#include "dragsourceconfig.h"
+#include "dragstress.h"
 
 #include "formgenwidgets-qt.h"
+#include "metricslog.h"
+#include "payloadgenerator.h"
 
 #include <QApplication>
 #include <QClipboard>
 #include <QCompleter>
 #include <QDataStream>
+#include <QDateTime>
 #include <QDesktopServices>
 #include <QDialogButtonBox>
+#include <QFile>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QInputDialog>
+#include <QJsonArray>
 #include <QLineEdit>
+#include <QMenu>
 #include <QMessageBox>
 #include <QMimeData>
 #include <QMimeDatabase>
+#include <QPushButton>
+#include <QRegularExpression>
+#include <QTimer>
 #include <QUrl>
 
+#include <limits>
+
 static const QString s_dragDataName = "name";
 static const QString s_dragDataSupCopy = "supportCopy";
 static const QString s_dragDataSupMove = "supportMove";
@@ -50,32 +64,126 @@ static const QString s_dragDataData = "data";
 static const QString s_dragDataBytes = "bytes";
 static const QString s_dragDataMime = "mime";
 
-static const char s_dragSourceConfigHead[] = "DragonDropTest.dragSourceConfig.0.1";
+static const QString s_generateName = "name";
+static const QString s_generateKind = "kind";
+static const QString s_generateMime = "mime";
+static const QString s_generateFormats = "formats";
+static const QString s_generateSize = "size";
+static const QString s_generateSeed = "seed";
+static const QString s_generatePattern = "pattern";
+static const QString s_generateCount = "count";
+static const QString s_generateWidth = "width";
+static const QString s_generateHeight = "height";
+
+static FormGenTextWidget *newMimeWidget(FormGenElement::ElementType type = FormGenElement::Required)
+{
+    auto *mimeEntry = new FormGenTextWidget(type);
+
+    QStringList mime;
+    const QList<QMimeType> db = QMimeDatabase().allMimeTypes();
+    for( auto it = db.cbegin(); it != db.cend(); ++it )
+        mime << it->name();
+    qSort(mime);
+
+    auto *c = new QCompleter(mime, mimeEntry);
+    mimeEntry->findChild<QLineEdit *>()->setCompleter(c);
+
+    return mimeEntry;
+}
+
+static const int s_memoryRefreshMsecs = 1000;
+
+static bool hasGeneratedData(const DnDAction &action)
+{
+    for( const auto &e : action.data ) {
+        if( e.source() && ! e.source()->generatorSpec().isEmpty() )
+            return true;
+    }
+    return false;
+}
 
 Widget::Widget(QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::Widget)
+    , mDropSequence(0)
+    , mMonitorChanges(0)
+    , mMonitorCaptures(0)
 {
     ui->setupUi(this);
 
     ui->listDrop->setModel(&mDropModel);
+    ui->listTimings->setModel(&mTimingsModel);
+    ui->listMemory->setModel(&mMemoryModel);
+    ui->listHistory->setModel(&mHistory);
+    ui->listDiff->setModel(&mDiffModel);
     ui->listDrag->setModel(&mDragModel);
 
+    connect(ui->labelDrop, SIGNAL(dropMeasured(DropTimings)), this, SLOT(onDropMeasured(DropTimings)));
     connect(ui->labelDrop, SIGNAL(dataDropped(int,DnDAction)), this, SLOT(onDataDropped(int,DnDAction)));
+    connect(&mDropModel, SIGNAL(rowFetched(int,qint64,qint64)), this, SLOT(onDropRowFetched(int,qint64,qint64)));
+    connect(&mDropModel, SIGNAL(rowHashed(int,qint64)), this, SLOT(onDropRowHashed(int,qint64)));
+    connect(&mDropModel, SIGNAL(rowDecoded(int,qint64)), this, SLOT(onDropRowDecoded(int,qint64)));
     onDataDropped(-2, {});
 
     connect(&mDragModel, SIGNAL(rowCountChanged()), this, SLOT(updateUi()));
     connect(ui->listDrag->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(updateUi()));
-    connect(&mDropModel, SIGNAL(modelReset()), this, SLOT(updateUi()));
+    connect(&mDropModel, SIGNAL(dropDataChanged()), this, SLOT(updateUi()));
     connect(ui->listDrop->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(updateUi()));
+    connect(&mDropModel, SIGNAL(dropDataChanged()), this, SLOT(showDropPayload()));
+    connect(ui->listDrop->selectionModel(), SIGNAL(currentChanged(QModelIndex,QModelIndex)), this, SLOT(showDropPayload()));
 
     connect(ui->buttonDragEdit, SIGNAL(clicked()), this, SLOT(dragEdit()));
+    connect(ui->buttonDragGenerate, SIGNAL(clicked()), this, SLOT(dragGenerate()));
     connect(ui->buttonDragLoad, SIGNAL(clicked()), this, SLOT(dragLoad()));
     connect(ui->buttonDragSave, SIGNAL(clicked()), this, SLOT(dragSave()));
+    connect(ui->buttonDragStress, SIGNAL(clicked()), this, SLOT(dragStress()));
     connect(ui->buttonDropClip, SIGNAL(clicked()), this, SLOT(dropClip()));
     connect(ui->buttonDropOpen, SIGNAL(clicked()), this, SLOT(dropOpen()));
     connect(ui->buttonDropSave, SIGNAL(clicked()), this, SLOT(dropSave()));
     connect(ui->buttonDropToDrag, SIGNAL(clicked()), this, SLOT(dropToDrag()));
+    connect(ui->buttonDropTargets, SIGNAL(clicked()), this, SLOT(dropTargets()));
+
+    auto *saveAllMenu = new QMenu(ui->buttonDropSaveAll);
+    saveAllMenu->addAction(tr("To directory..."), this, SLOT(dropSaveAllToDirectory()));
+    saveAllMenu->addAction(tr("To tar archive..."), this, SLOT(dropSaveAllToArchive()));
+    ui->buttonDropSaveAll->setMenu(saveAllMenu);
+
+    for( int i = 0; i < ChunkedHash::AlgorithmCount; ++i )
+        ui->comboDropHash->addItem(ChunkedHash::name(ChunkedHash::Algorithm(i)));
+    ui->comboDropHash->setCurrentIndex(mDropModel.hashAlgorithm());
+    connect(ui->comboDropHash, SIGNAL(currentIndexChanged(int)), this, SLOT(dropHashAlgorithm(int)));
+    connect(ui->checkDropLazy, SIGNAL(toggled(bool)), this, SLOT(dropLazyFetch(bool)));
+    connect(ui->checkDropMonitor, SIGNAL(toggled(bool)), this, SLOT(dropMonitorClipboard(bool)));
+    ui->spinDropDeadline->setValue(ui->labelDrop->formatDeadline());
+    connect(ui->spinDropDeadline, SIGNAL(valueChanged(int)), this, SLOT(dropFormatDeadline(int)));
+    connect(ui->labelDrop, SIGNAL(clipboardMonitored(QString,int,bool)),
+            this, SLOT(onClipboardMonitored(QString,int,bool)));
+    ui->spinHistoryBudget->setValue(int(mHistory.memoryBudget() / (1024 * 1024)));
+    connect(ui->spinHistoryBudget, SIGNAL(valueChanged(int)), this, SLOT(dropHistoryBudget(int)));
+    connect(ui->listHistory, SIGNAL(doubleClicked(QModelIndex)), this, SLOT(dropHistoryActivated(QModelIndex)));
+    connect(&mHistory, SIGNAL(statsChanged()), this, SLOT(updateHistoryStats()));
+    connect(ui->listHistory->selectionModel(), SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
+            this, SLOT(updateUi()));
+    connect(ui->buttonHistoryDiff, SIGNAL(clicked()), this, SLOT(dropHistoryDiff()));
+    connect(&mDiffModel, SIGNAL(compared(qint64)), this, SLOT(onDiffCompared(qint64)));
+    connect(ui->comboViewMode, SIGNAL(currentIndexChanged(int)), ui->viewPayload, SLOT(setMode(int)));
+    connect(ui->lineViewOffset, SIGNAL(returnPressed()), this, SLOT(viewGoToOffset()));
+    connect(ui->lineViewFind, SIGNAL(returnPressed()), this, SLOT(viewFind()));
+    connect(ui->buttonViewFind, SIGNAL(clicked()), this, SLOT(viewFind()));
+    connect(ui->viewPayload, SIGNAL(found(qint64,qint64)), this, SLOT(onViewFound(qint64,qint64)));
+    connect(ui->viewPayload, SIGNAL(cursorChanged(qint64)), this, SLOT(onViewCursor(qint64)));
+    connect(&mExporter, SIGNAL(progress(int,qint64,qint64)), this, SLOT(onExportProgress(int,qint64,qint64)));
+    connect(&mExporter, SIGNAL(finished(int,QString,qint64)), this, SLOT(onExportFinished(int,QString,qint64)));
+    updateHistoryStats();
+    auto *memoryTimer = new QTimer(this);
+    connect(memoryTimer, SIGNAL(timeout()), &mMemoryModel, SLOT(refresh()));
+    memoryTimer->start(s_memoryRefreshMsecs);
+    connect(ui->checkDragPromise, SIGNAL(toggled(bool)), this, SLOT(dragPromise(bool)));
+    connect(ui->spinDragDelay, SIGNAL(valueChanged(int)), this, SLOT(dragDelay(int)));
+    connect(ui->labelDrag, SIGNAL(dragMeasured(int,qint64,qint64,QStringList)),
+            this, SLOT(onDragMeasured(int,qint64,qint64,QStringList)));
+    connect(ui->labelDrag, SIGNAL(formatRetrieved(QString,qint64,qint64)),
+            this, SLOT(onDragFormatRetrieved(QString,qint64,qint64)));
 
     updateUi();
 }
@@ -88,13 +196,20 @@ Widget::~Widget()
 
 void Widget::updateUi()
 {
-    const bool dropDataSelected = ui->listDrop->selectionModel()->currentIndex().row() >= 0 && mDropModel.rowCount() > 0;
+    const int dropRow = ui->listDrop->selectionModel()->currentIndex().row();
+    const bool dropDataSelected = dropRow >= 0 && mDropModel.rowCount() > 0;
+    if( dropDataSelected )
+        mDropModel.fetch(dropRow);
+
     ui->buttonDropClip->setEnabled(dropDataSelected);
     ui->buttonDropOpen->setEnabled(dropDataSelected);
     ui->buttonDropSave->setEnabled(dropDataSelected);
+    ui->buttonDropSaveAll->setEnabled(mDropModel.rowCount() > 0);
+    ui->buttonHistoryDiff->setEnabled(ui->listHistory->selectionModel()->selectedRows().size() == 2);
 
     ui->buttonDragSave->setEnabled(mDragModel.rowCount() > 0);
     const int dragRow = ui->listDrag->selectionModel()->currentIndex().row();
+    ui->buttonDragStress->setEnabled(dragRow >= 0);
     if( dragRow < 0 ) {
         ui->labelDrag->setData({});
         ui->labelDragSupported->setText({});
@@ -118,14 +233,7 @@ void Widget::dropSave()
     if( fileName.isEmpty() )
         return;
 
-    QFile f(fileName);
-    if( ! f.open(QIODevice::WriteOnly) ) {
-        showError(tr("Save drop: cannot open file to save"));
-        return;
-    }
-
-    f.write(mDropModel.dropData(row));
-    f.close();
+    exportDropPayload(row, fileName, false);
 }
 
 void Widget::dropOpen()
@@ -141,12 +249,165 @@ void Widget::dropOpen()
         showError(tr("Open drop: could not create temporary file"));
         return;
     }
-
-    mTmpFile->write(mDropModel.dropData(row));
     mTmpFile->close();
 
-    if( ! QDesktopServices::openUrl(QUrl::fromLocalFile(mTmpFile->fileName())) )
-        showError(tr("Open drop: could not open temporary file %1").arg(mTmpFile->fileName()));
+    exportDropPayload(row, mTmpFile->fileName(), true);
+}
+
+void Widget::showDropPayload()
+{
+    const int row = ui->listDrop->selectionModel()->currentIndex().row();
+    if( row < 0 || row >= mDropModel.rowCount() )
+        ui->viewPayload->setPayload(Payload());
+    else
+        ui->viewPayload->setPayload(mDropModel.dropPayload(row));
+}
+
+void Widget::viewGoToOffset()
+{
+    bool ok;
+    const qint64 offset = ui->lineViewOffset->text().trimmed().toLongLong(&ok, 0);
+    if( ! ok ) {
+        ui->labelView->setText(tr("Invalid offset"));
+        return;
+    }
+
+    ui->viewPayload->goToOffset(offset);
+}
+
+void Widget::viewFind()
+{
+    const QString text = ui->lineViewFind->text();
+    QByteArray needle;
+    if( ui->checkViewFindHex->isChecked() )
+        needle = QByteArray::fromHex(text.toLatin1());
+    else
+        needle = text.toUtf8();
+
+    ui->labelView->setText(tr("Searching..."));
+    ui->viewPayload->find(needle);
+}
+
+void Widget::onViewFound(qint64 offset, qint64 nsecs)
+{
+    if( offset < 0 )
+        ui->labelView->setText(tr("Not found"));
+    else
+        ui->labelView->setText(tr("Found at offset %1 (0x%2) in %3 ms")
+                               .arg(offset).arg(offset, 0, 16).arg(double(nsecs) / 1e6, 0, 'f', 1));
+}
+
+void Widget::onViewCursor(qint64 offset)
+{
+    const qint64 size = ui->viewPayload->payload().size();
+    if( offset < 0 )
+        ui->labelView->setText(tr("%1 bytes").arg(size));
+    else
+        ui->labelView->setText(tr("Offset %1 (0x%2) of %3 bytes").arg(offset).arg(offset, 0, 16).arg(size));
+}
+
+void Widget::dropSaveAllToDirectory()
+{
+    const QString dir = QFileDialog::getExistingDirectory(this, tr("Save all drop formats to directory"));
+    if( dir.isEmpty() )
+        return;
+
+    exportDropBatch(PayloadExporter::Directory, dir);
+}
+
+void Widget::dropSaveAllToArchive()
+{
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Save all drop formats to archive"),
+                                                          QString(), tr("Tar archives (*.tar)"));
+    if( fileName.isEmpty() )
+        return;
+
+    exportDropBatch(PayloadExporter::TarArchive, fileName);
+}
+
+void Widget::exportDropPayload(int row, const QString &fileName, bool open)
+{
+    const Payload payload = mDropModel.dropPayload(row);
+    trackExport(mExporter.save(payload, fileName), fileName, payload.size(), open);
+}
+
+void Widget::exportDropBatch(PayloadExporter::BatchTarget target, const QString &path)
+{
+    static const QRegularExpression unsafe("[^A-Za-z0-9._-]");
+
+    const DnDAction act = mDropModel.dropActionData();
+    QVector<PayloadExporter::File> files;
+    qint64 bytes = 0;
+    for( int row = 0; row < act.data.size(); ++row ) {
+        const auto &entry = act.data.at(row);
+
+        PayloadExporter::File f;
+        f.name = QString("%1-%2").arg(row, 3, 10, QChar('0')).arg(QString(entry.mime()).replace(unsafe, "_").left(80));
+        if( ! entry.fileExtension().isEmpty() )
+            f.name += "." + entry.fileExtension();
+        f.payload = entry.payload();
+        f.info["mime"] = entry.mime();
+        f.info["extension"] = entry.fileExtension();
+        files.append(f);
+        bytes += f.payload.size();
+    }
+
+    QJsonObject info;
+    info["drop"] = mDropSequence;
+    info["action"] = mDropModel.dropActioString();
+    info["supportedActions"] = DnDAction::actionsToString(act.supportedActions);
+    info["defaultAction"] = DnDAction::actionsToString(act.defaultAction);
+    info["time"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+
+    trackExport(mExporter.saveAll(files, info, target, path), path, bytes, false);
+}
+
+void Widget::trackExport(int id, const QString &fileName, qint64 bytes, bool open)
+{
+    PendingExport e;
+    e.fileName = fileName;
+    e.open = open;
+    e.bytes = bytes;
+    e.dialog = new QProgressDialog(tr("Writing %1").arg(QFileInfo(fileName).fileName()), tr("Cancel"), 0, 1000, this);
+    e.dialog->setMinimumDuration(500);
+    e.dialog->setAutoClose(false);
+    e.dialog->setAutoReset(false);
+    connect(e.dialog.data(), &QProgressDialog::canceled, this, [this, id]() {
+        mExporter.cancel(id);
+        const PendingExport e = mExports.take(id);
+        if( e.dialog )
+            e.dialog->deleteLater();
+    });
+    mExports.insert(id, e);
+}
+
+void Widget::onExportProgress(int id, qint64 written, qint64 total)
+{
+    const PendingExport e = mExports.value(id);
+    if( e.dialog && total > 0 )
+        e.dialog->setValue(int(qMin(written, total) * 1000 / total));
+}
+
+void Widget::onExportFinished(int id, const QString &errorString, qint64 nsecs)
+{
+    const PendingExport e = mExports.take(id);
+    if( e.dialog )
+        e.dialog->deleteLater();
+
+    QJsonObject record;
+    record["file"] = e.fileName;
+    record["bytes"] = double(e.bytes);
+    record["exportMs"] = double(nsecs) / 1e6;
+    record["error"] = errorString;
+    MetricsLog::instance().write("export", record);
+
+    if( ! errorString.isEmpty() ) {
+        showError(e.open ? tr("Open drop: %1").arg(errorString) : tr("Save drop: %1").arg(errorString));
+        return;
+    }
+
+    if( e.open && ! QDesktopServices::openUrl(QUrl::fromLocalFile(e.fileName)) )
+        showError(tr("Open drop: could not open temporary file %1").arg(e.fileName));
 }
 
 void Widget::dropClip()
@@ -154,45 +415,190 @@ void Widget::dropClip()
     const int row = ui->listDrop->selectionModel()->currentIndex().row();
 
     auto *clipboardData = new QMimeData;
-    clipboardData->setData(mDropModel.dropMimeType(row),
-                           mDropModel.dropData(row));
+    const QByteArray bytes = mDropModel.dropData(row);
+    clipboardData->setData(mDropModel.dropMimeType(row), bytes);
+    MemoryAccounting::instance().holdUntilDestroyed(clipboardData, tr("Mime data"),
+                                                    { MemoryAccounting::Holding::of(bytes) });
 
     QApplication::clipboard()->setMimeData(clipboardData);
 }
 
+void Widget::dropHashAlgorithm(int index)
+{
+    mDropModel.setHashAlgorithm(ChunkedHash::Algorithm(index));
+}
 
-void Widget::loadDragSourceConfig(const QUrl &configUrl)
+void Widget::dropLazyFetch(bool lazy)
 {
-    mDragModel.clear();
+    ui->labelDrop->setLazyFetch(lazy);
+}
 
-    QFile file(configUrl.toLocalFile());
-    if ( ! file.open(QIODevice::ReadOnly)) {
-        showError(tr("Cannot open config file %1").arg(configUrl.toString()));
-        return;
-    }
+void Widget::dropFormatDeadline(int msecs)
+{
+    ui->labelDrop->setFormatDeadline(msecs);
+}
 
-    QDataStream stream(&file);
-    stream.setVersion(QDataStream::Qt_5_2);
-    {
-        char headerTmp[sizeof(s_dragSourceConfigHead)];
-        stream.readRawData(headerTmp, sizeof(s_dragSourceConfigHead));
-        if( qstrcmp(headerTmp, s_dragSourceConfigHead) != 0 ) {
-            showError(tr("Invalid config file"));
-            return;
-        }
+void Widget::dropMonitorClipboard(bool monitor)
+{
+    ui->labelDrop->setMonitorClipboard(monitor);
+}
+
+void Widget::dropTargets()
+{
+    if( ! mDropTargets ) {
+        mDropTargets = new DropTargetGrid(this);
+        mDropTargets->setWindowFlags(Qt::Window);
+        mDropTargets->setAttribute(Qt::WA_DeleteOnClose);
+        mDropTargets->resize(800, 600);
     }
+    mDropTargets->show();
+    mDropTargets->raise();
+    mDropTargets->activateWindow();
+}
+
+void Widget::onClipboardMonitored(const QString &origin, int changes, bool captured)
+{
+    mMonitorChanges += changes;
+    if( captured )
+        ++mMonitorCaptures;
+    ui->checkDropMonitor->setText(tr("Monitor clipboard (%1 changes, %2 captured)")
+                                  .arg(mMonitorChanges).arg(mMonitorCaptures));
+
+    QJsonObject record;
+    record["origin"] = origin;
+    record["changes"] = changes;
+    record["captured"] = captured;
+    if( captured )
+        record["drop"] = mDropSequence + 1;
+    MetricsLog::instance().write("clipboard", record);
+}
 
-    stream >> mDragModel;
+void Widget::dropHistoryBudget(int mib)
+{
+    mHistory.setMemoryBudget(qint64(mib) * 1024 * 1024);
+}
+
+void Widget::dropHistoryActivated(const QModelIndex &index)
+{
+    if( ! index.isValid() )
+        return;
+
+    showDropData(mHistory.dropAction(index.row()), mHistory.capture(index.row()));
+}
+
+void Widget::updateHistoryStats()
+{
+    const double mib = 1024 * 1024;
+    ui->labelHistory->setText(tr("%1 captures, %2 MiB in memory, %3 MiB on disk, %4 MiB deduplicated")
+                              .arg(mHistory.rowCount())
+                              .arg(mHistory.residentBytes() / mib, 0, 'f', 1)
+                              .arg(mHistory.spilledBytes() / mib, 0, 'f', 1)
+                              .arg(mHistory.sharedBytes() / mib, 0, 'f', 1));
+}
+
+void Widget::dropHistoryDiff()
+{
+    QModelIndexList rows = ui->listHistory->selectionModel()->selectedRows();
+    if( rows.size() != 2 )
+        return;
+
+    // Rows are newest first.
+    qSort(rows);
+    const int rowA = rows.at(1).row();
+    const int rowB = rows.at(0).row();
+
+    ui->labelDiff->setText(tr("Comparing capture %1 (A) with capture %2 (B)...")
+                           .arg(mHistory.index(rowA, 0).data().toString())
+                           .arg(mHistory.index(rowB, 0).data().toString()));
+    ui->tabsDrop->setCurrentWidget(ui->tabDropDiff);
+    mDiffModel.compare(mHistory.capture(rowA), mHistory.capture(rowB));
+}
+
+void Widget::onDiffCompared(qint64 nsecs)
+{
+    ui->labelDiff->setText(tr("%1 added, %2 removed, %3 changed, %4 unchanged in %5 ms")
+                           .arg(mDiffModel.count(DropDiffModel::Added))
+                           .arg(mDiffModel.count(DropDiffModel::Removed))
+                           .arg(mDiffModel.count(DropDiffModel::Changed))
+                           .arg(mDiffModel.count(DropDiffModel::Unchanged))
+                           .arg(double(nsecs) / 1e6, 0, 'f', 1));
+
+    QJsonObject record = mDiffModel.toJson();
+    record["diffMs"] = double(nsecs) / 1e6;
+    MetricsLog::instance().write("diff", record);
+}
+
+
+void Widget::loadDragSourceConfig(const QUrl &configUrl)
+{
+    QString error;
+    if( ! DragSourceConfig::load(configUrl.toLocalFile(), mDragModel, &error) )
+        showError(error);
+}
+
+void Widget::onDropMeasured(const DropTimings &timings)
+{
+    ++mDropSequence;
+    mTimingsModel.setTimings(timings);
 }
 
 void Widget::onDataDropped(int dropAction, const DnDAction &data)
+{
+    showDropData(dropAction, data);
+    if( dropAction != -2 ) {
+        mTimingsModel.setModelReset(mDropModel.lastResetNsecs());
+
+        QJsonObject record = mTimingsModel.timings().toJson();
+        record["drop"] = mDropSequence;
+        record["action"] = mDropModel.dropActioString();
+        MetricsLog::instance().write("drop", record);
+
+        mHistory.record(dropAction, data);
+    }
+}
+
+void Widget::showDropData(int dropAction, const DnDAction &data)
 {
     mDropModel.setDropData(dropAction, data);
+
     ui->labelDrop->setDropActionString(mDropModel.dropActioString());
     ui->labelDropPossible->setText(tr("Possible actions:  %1").arg(DnDAction::actionsToString(data.supportedActions)));
     ui->labelDropSuggested->setText(tr("Suggested action:  %1").arg(DnDAction::actionsToString(data.defaultAction)));
 }
 
+void Widget::onDropRowFetched(int row, qint64 nsecs, qint64 bytes)
+{
+    mTimingsModel.setFetched(row, nsecs, bytes);
+
+    QJsonObject record;
+    record["drop"] = mDropSequence;
+    record["mime"] = mDropModel.dropMimeType(row);
+    record["fetchMs"] = double(nsecs) / 1e6;
+    record["bytes"] = double(bytes);
+    MetricsLog::instance().write("fetch", record);
+}
+
+void Widget::onDropRowHashed(int row, qint64 nsecs)
+{
+    mTimingsModel.setHashed(row, nsecs);
+
+    QJsonObject record;
+    record["drop"] = mDropSequence;
+    record["mime"] = mDropModel.dropMimeType(row);
+    record["algorithm"] = ChunkedHash::name(mDropModel.hashAlgorithm());
+    record["hashMs"] = double(nsecs) / 1e6;
+    MetricsLog::instance().write("hash", record);
+}
+
+void Widget::onDropRowDecoded(int row, qint64 nsecs)
+{
+    QJsonObject record;
+    record["drop"] = mDropSequence;
+    record["mime"] = mDropModel.dropMimeType(row);
+    record["decodeMs"] = double(nsecs) / 1e6;
+    MetricsLog::instance().write("decode", record);
+}
+
 
 void Widget::dragLoad()
 {
@@ -227,18 +633,7 @@ void Widget::dragEdit()
         dragSource->addElement(s_dragDataDefault, defaultDrag, tr("Default action"));
 
         auto * dataElement = new FormGenRecordComposition;
-        auto *mimeEntry = new FormGenTextWidget;
-        {
-            QStringList mime;
-            const QList<QMimeType> db = QMimeDatabase().allMimeTypes();
-            for( auto it = db.cbegin(); it != db.cend(); ++it )
-                mime << it->name();
-            qSort(mime);
-
-            auto *c = new QCompleter(mime, mimeEntry);
-            mimeEntry->findChild<QLineEdit *>()->setCompleter(c);
-        }
-        dataElement->addElement(s_dragDataMime, mimeEntry, tr("MIME"));
+        dataElement->addElement(s_dragDataMime, newMimeWidget(), tr("MIME"));
         auto * bytes = new FormGenByteArrayWidget;
         dataElement->addElement(s_dragDataBytes, bytes, tr("Bytes"));
         auto * dataList = new FormGenListBagComposition(FormGenListBagComposition::BagMode);
@@ -264,7 +659,119 @@ void Widget::dragEdit()
     if( dialog.exec() != QDialog::Accepted )
         return;
 
+    // Generated entries are not editable, they are kept as they are.
+    QVector<DragSourceModel::DragSourceEntry> generated;
+    for( const auto &entry : mDragModel ) {
+        if( hasGeneratedData(entry.action) )
+            generated.append(entry);
+    }
+
     loadDragSourceConfig(dragSourceList->value().toList());
+    for( const auto &entry : generated )
+        mDragModel.append(entry);
+}
+
+void Widget::dragGenerate()
+{
+    QDialog dialog;
+    dialog.setWindowTitle(tr("Generate drag source"));
+    auto *layout = new QVBoxLayout;
+
+    auto *generator = new FormGenRecordComposition;
+    generator->frameWidget()->setTitle(dialog.windowTitle());
+    {
+        generator->addElement(s_generateName, new FormGenTextWidget, tr("Name"));
+
+        auto *kind = new FormGenEnumWidget;
+        for( const auto &k : PayloadGenerator::kindNames() )
+            kind->addEnumValue(k);
+        generator->addElement(s_generateKind, kind, tr("Kind"));
+
+        generator->addElement(s_generateMime, newMimeWidget(FormGenElement::Optional), tr("MIME (default depends on kind)"));
+
+        auto *formats = new FormGenIntWidget;
+        formats->setMinimum(1);
+        formats->setMaximum(100000);
+        generator->addElement(s_generateFormats, formats, tr("Formats (fan-out)"));
+
+        auto *size = new FormGenTextWidget;
+        generator->addElement(s_generateSize, size, tr("Size (random, pattern; K/M/G suffix)"));
+
+        auto *seed = new FormGenIntWidget;
+        seed->setMaximum(std::numeric_limits<int>::max());
+        generator->addElement(s_generateSeed, seed, tr("Seed"));
+
+        generator->addElement(s_generatePattern, new FormGenTextWidget(FormGenElement::Optional), tr("Pattern"));
+
+        auto *count = new FormGenIntWidget;
+        count->setMaximum(std::numeric_limits<int>::max());
+        generator->addElement(s_generateCount, count, tr("URL count (uri list)"));
+
+        auto *width = new FormGenIntWidget;
+        width->setMaximum(1 << 20);
+        generator->addElement(s_generateWidth, width, tr("Width (image)"));
+
+        auto *height = new FormGenIntWidget;
+        height->setMaximum(1 << 20);
+        generator->addElement(s_generateHeight, height, tr("Height (image)"));
+
+        formats->setValue(1);
+        count->setValue(1000);
+        width->setValue(4096);
+        height->setValue(4096);
+        size->setValue(QString("64M"));
+    }
+    layout->addWidget(generator);
+
+    auto *buttonBox = new QDialogButtonBox;
+    buttonBox->setOrientation(Qt::Horizontal);
+    buttonBox->setStandardButtons(QDialogButtonBox::Cancel|QDialogButtonBox::Ok);
+    buttonBox->connect(buttonBox, &QDialogButtonBox::accepted, &dialog, &QDialog::accept);
+    buttonBox->connect(buttonBox, &QDialogButtonBox::rejected, &dialog, &QDialog::reject);
+    layout->addWidget(buttonBox);
+
+    dialog.setLayout(layout);
+
+    if( dialog.exec() != QDialog::Accepted )
+        return;
+
+    const QVariantHash v = generator->value().toHash();
+    const auto kind = PayloadGenerator::Kind(PayloadGenerator::kindNames().indexOf(v.value(s_generateKind).toHash().cbegin().key()));
+    const qint64 size = PayloadGenerator::parseSize(v.value(s_generateSize).toString());
+    if( size < 0 && (kind == PayloadGenerator::RandomBytes || kind == PayloadGenerator::Pattern) ) {
+        showError(tr("Generate drag source: invalid size"));
+        return;
+    }
+
+    QString mime = v.value(s_generateMime).toString();
+    if( mime.isEmpty() )
+        mime = PayloadGenerator::defaultMime(kind);
+
+    DragSourceModel::DragSourceEntry e;
+    e.name = v.value(s_generateName).toString();
+    e.action.supportedActions = Qt::CopyAction | Qt::MoveAction;
+    e.action.defaultAction = Qt::CopyAction;
+
+    const int formats = v.value(s_generateFormats).toInt();
+    for( int i = 0; i < formats; ++i ) {
+        const QVariantMap spec = PayloadGenerator::spec(kind, size, v.value(s_generateSeed).toUInt() + i,
+                                                        v.value(s_generatePattern).toString().toUtf8(),
+                                                        v.value(s_generateCount).toInt(),
+                                                        v.value(s_generateWidth).toInt(),
+                                                        v.value(s_generateHeight).toInt());
+        auto *source = new PayloadGenerator(spec);
+        if( ! source->isValid() ) {
+            delete source;
+            showError(tr("Generate drag source: invalid parameters (at most %1 MiB per format)")
+                      .arg(PayloadGenerator::maxSize() / (1024 * 1024)));
+            return;
+        }
+
+        const QString formatMime = formats > 1 ? QString("%1;index=%2").arg(mime).arg(i) : mime;
+        e.action.data.append(DnDAction::DataEntry(formatMime, QSharedPointer<PayloadSource>(source)));
+    }
+
+    mDragModel.append(e);
 }
 
 void Widget::dragSave()
@@ -278,16 +785,104 @@ void Widget::dragSave()
     if( ! saveFile.contains('.') )
         saveFile.append(".dndtest");
 
-    QFile file(saveFile);
-    if( ! file.open(QIODevice::WriteOnly) ) {
-        showError(tr("Save drag config: cannot open file"));
+    QString error;
+    if( ! DragSourceConfig::save(saveFile, mDragModel, &error) )
+        showError(error);
+}
+
+void Widget::dragPromise(bool promise)
+{
+    ui->labelDrag->setPromiseMode(promise);
+    ui->spinDragDelay->setEnabled(promise);
+}
+
+void Widget::dragDelay(int msecs)
+{
+    ui->labelDrag->setGenerationDelay(msecs);
+}
+
+void Widget::dragStress()
+{
+    const int dragRow = ui->listDrag->selectionModel()->currentIndex().row();
+    if( dragRow < 0 )
+        return;
+
+    const QStringList modes = { tr("Simulated drags"), tr("Clipboard") };
+    bool ok = false;
+    const QString mode = QInputDialog::getItem(this, tr("Stress test"), tr("Repeat through:"), modes, 0, false, &ok);
+    if( ! ok )
+        return;
+    const int iterations = QInputDialog::getInt(this, tr("Stress test"), tr("Iterations:"), 1000, 1, 1000000, 100, &ok);
+    if( ! ok )
+        return;
+
+    const auto &entry = mDragModel.at(dragRow);
+    DragStress stress;
+    stress.setMode(mode == modes.at(1) ? DragStress::Clipboard : DragStress::Drag);
+    stress.setIterations(iterations);
+    stress.setPromiseMode(ui->labelDrag->promiseMode());
+    stress.setGenerationDelay(ui->labelDrag->generationDelay());
+
+    QProgressDialog progress(tr("Repeating \"%1\"...").arg(entry.name), tr("Cancel"), 0, iterations, this);
+    progress.setWindowModality(Qt::WindowModal);
+    progress.setMinimumDuration(0);
+    connect(&stress, SIGNAL(progress(int,int)), &progress, SLOT(setValue(int)));
+    connect(&progress, SIGNAL(canceled()), &stress, SLOT(cancel()));
+    stress.run(entry.action);
+    progress.reset();
+
+    QJsonObject record = stress.toJson();
+    record["source"] = entry.name;
+    MetricsLog::instance().write("stress", record);
+
+    const QJsonObject deliver = stress.deliverLatency().toJson();
+    QMessageBox box(QMessageBox::Information, tr("Stress test"),
+                    tr("%1 iterations\ndelivery p50 %2 ms, p99 %3 ms, p99.9 %4 ms, max %5 ms")
+                    .arg(stress.deliverLatency().count())
+                    .arg(deliver.value("p50Ms").toDouble(), 0, 'f', 3)
+                    .arg(deliver.value("p99Ms").toDouble(), 0, 'f', 3)
+                    .arg(deliver.value("p999Ms").toDouble(), 0, 'f', 3)
+                    .arg(deliver.value("maxMs").toDouble(), 0, 'f', 3),
+                    QMessageBox::Close, this);
+    QPushButton *save = box.addButton(tr("Save CSV..."), QMessageBox::ActionRole);
+    box.exec();
+    if( box.clickedButton() != save )
+        return;
+
+    const QString fileName = QFileDialog::getSaveFileName(this, tr("Save latency histograms"),
+                                                          QString(), tr("CSV files (*.csv)"));
+    if( fileName.isEmpty() )
+        return;
+
+    QFile file(fileName);
+    if( ! file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text) ) {
+        showError(tr("Could not write %1: %2").arg(fileName, file.errorString()));
         return;
     }
+    stress.writeCsv(&file);
+}
+
+void Widget::onDragMeasured(int dropAction, qint64 setupNsecs, qint64 execNsecs, const QStringList &retrieved)
+{
+    const int dragRow = ui->listDrag->selectionModel()->currentIndex().row();
+
+    QJsonObject record;
+    record["source"] = dragRow < 0 ? QString() : mDragModel.at(dragRow).name;
+    record["action"] = DnDAction::actionsToString(static_cast<Qt::DropAction>(dropAction));
+    record["promise"] = ui->labelDrag->promiseMode();
+    record["setupMs"] = double(setupNsecs) / 1e6;
+    record["execMs"] = double(execNsecs) / 1e6;
+    record["retrieved"] = QJsonArray::fromStringList(retrieved);
+    MetricsLog::instance().write("drag", record);
+}
 
-    QDataStream stream(&file);
-    stream.setVersion(QDataStream::Qt_5_2);
-    stream.writeRawData(s_dragSourceConfigHead, sizeof(s_dragSourceConfigHead));
-    stream << mDragModel;
+void Widget::onDragFormatRetrieved(const QString &mimeType, qint64 bytes, qint64 nsecs)
+{
+    QJsonObject record;
+    record["mime"] = mimeType;
+    record["bytes"] = double(bytes);
+    record["retrieveMs"] = double(nsecs) / 1e6;
+    MetricsLog::instance().write("retrieve", record);
 }
 
 void Widget::dropToDrag()
@@ -375,6 +970,9 @@ QVariantList Widget::dragSourceConfigVariant() const
     QVariantList data;
 
     for( const auto &entry : mDragModel ) {
+        if( hasGeneratedData(entry.action) )
+            continue;
+
         QVariantHash e;
         e[s_dragDataName] = entry.name;
         e[s_dragDataSupCopy] = bool(entry.action.supportedActions & Qt::CopyAction);
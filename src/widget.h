@@ -20,8 +20,17 @@
 #define WIDGET_H
 
 #include "dragsource.h"
+#include "dropdiff.h"
+#include "drophistory.h"
 #include "droparea.h"
+#include "droptargetgrid.h"
+#include "droptimings.h"
+#include "memoryaccounting.h"
+#include "payloadexporter.h"
+#include "payloadview.h"
 
+#include <QPointer>
+#include <QProgressDialog>
 #include <QTemporaryFile>
 #include <QWidget>
 
@@ -41,29 +50,80 @@ public:
     void loadDragSourceConfig(const QUrl &configUrl);
 
 private slots:
+    void onDropMeasured(const DropTimings &timings);
     void onDataDropped(int dropAction, const DnDAction &data);
+    void onDropRowFetched(int row, qint64 nsecs, qint64 bytes);
+    void onDropRowHashed(int row, qint64 nsecs);
+    void onDropRowDecoded(int row, qint64 nsecs);
     void updateUi();
 
     void dropSave();
     void dropOpen();
+    void dropSaveAllToDirectory();
+    void dropSaveAllToArchive();
     void dropClip();
+    void dropHashAlgorithm(int index);
+    void dropLazyFetch(bool lazy);
+    void dropFormatDeadline(int msecs);
+    void dropMonitorClipboard(bool monitor);
+    void dropTargets();
+    void onClipboardMonitored(const QString &origin, int changes, bool captured);
+    void onExportProgress(int id, qint64 written, qint64 total);
+    void onExportFinished(int id, const QString &errorString, qint64 nsecs);
+    void dropHistoryBudget(int mib);
+    void dropHistoryActivated(const QModelIndex &index);
+    void updateHistoryStats();
+    void dropHistoryDiff();
+    void showDropPayload();
+    void viewGoToOffset();
+    void viewFind();
+    void onViewFound(qint64 offset, qint64 nsecs);
+    void onViewCursor(qint64 offset);
+    void onDiffCompared(qint64 nsecs);
 
     void dragLoad();
     void dragEdit();
+    void dragGenerate();
     void dragSave();
+    void dragPromise(bool promise);
+    void dragDelay(int msecs);
+    void dragStress();
+    void onDragMeasured(int dropAction, qint64 setupNsecs, qint64 execNsecs, const QStringList &retrieved);
+    void onDragFormatRetrieved(const QString &mimeType, qint64 bytes, qint64 nsecs);
 
     void dropToDrag();
 
     void showError(const QString &message);
 
 private:
+    struct PendingExport {
+        QPointer<QProgressDialog> dialog;
+        QString fileName;
+        qint64 bytes = 0;
+        bool open = false;
+    };
+
+    void showDropData(int dropAction, const DnDAction &data);
+    void exportDropPayload(int row, const QString &fileName, bool open);
+    void exportDropBatch(PayloadExporter::BatchTarget target, const QString &path);
+    void trackExport(int id, const QString &fileName, qint64 bytes, bool open);
     void loadDragSourceConfig(const QVariantList &data);
     QVariantList dragSourceConfigVariant() const;
 
     Ui::Widget *ui;
     DropDataModel mDropModel;
+    DropTimingsModel mTimingsModel;
+    MemoryAccountingModel mMemoryModel;
+    DropHistory mHistory;
+    DropDiffModel mDiffModel;
+    int mDropSequence;
+    qint64 mMonitorChanges;
+    qint64 mMonitorCaptures;
     DragSourceModel mDragModel;
     QScopedPointer<QTemporaryFile> mTmpFile;
+    PayloadExporter mExporter;
+    QHash<int, PendingExport> mExports;
+    QPointer<DropTargetGrid> mDropTargets;
 };
 
 #endif // WIDGET_H